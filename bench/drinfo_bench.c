@@ -0,0 +1,418 @@
+// Benchmark of the whole report pipeline on synthetic systems. For each
+// table size it builds a fixture root with a mountinfo file, /dev nodes,
+// /dev/disk/by-* links and a gvfs directory, points drinfo at it through
+// system_root and times every phase of discover_drives(), sorting and
+// rendering. Results are compared with a stored baseline; a phase that got
+// clearly slower is reported and makes the run fail.
+//
+// Usage: bench/drinfo_bench [--update] [BASELINE] (default bench/baseline.txt)
+
+#define main drinfo_main
+#include "../main.c"
+#undef main
+
+#include <ftw.h>
+
+#define DEFAULT_BASELINE "bench/baseline.txt"
+#define BENCH_ROUNDS 5             // Each phase reports its fastest round
+#define BENCH_DEV_MAJOR 240        // Block major reserved for local use, so no real driver
+#define BENCH_NET_MINOR 100000     // First anonymous minor of the network mounts
+#define REGRESSION_FACTOR 1.5      // Slower than baseline by this much is a regression...
+#define REGRESSION_MIN_MS 0.5      // ...if it also lost at least this much time
+#define MAX_BASELINE_ENTRIES 256
+
+static const int table_sizes[] = {100, 1000, 10000, 50000};
+
+typedef enum
+{
+    PHASE_PARSE,
+    PHASE_FILTER,
+    PHASE_GVFS,
+    PHASE_GROUP,
+    PHASE_UDEV,
+    PHASE_PROBE,
+    PHASE_TABLE,
+    PHASE_SORT,
+    PHASE_TEXT,
+    PHASE_JSON,
+    PHASE_COUNT
+} phase_t;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "parse", "filter", "gvfs", "group", "udev", "probe", "table", "sort", "text", "json"};
+
+typedef struct
+{
+    int size;
+    char phase[16];
+    double ms;
+} baseline_entry_t;
+
+// Helper: monotonic time in nanoseconds
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * NS_PER_SECOND + ts.tv_nsec;
+}
+
+// Helper: create a directory and any missing parents below the fixture root
+bool make_fixture_dir(const char *root, const char *path)
+{
+    char full[MAX_ROOTED_PATH_LENGTH];
+    int length = snprintf(full, sizeof(full), "%s%s", root, path);
+    for (int i = (int)strlen(root) + 1; i <= length; i++)
+    {
+        if (full[i] != '/' && full[i] != '\0')
+            continue;
+        char saved = full[i];
+        full[i] = '\0';
+        if (mkdir(full, 0755) != 0 && errno != EEXIST)
+            return false;
+        full[i] = saved;
+    }
+    return true;
+}
+
+// Function to write a fixture root for a mount table of the given size:
+// 10% physical disks, 20% bind mounts of them, 10% NFS and 60% of the
+// container noise (overlays, proc, tmpfs, cgroups, snaps) drinfo skips
+bool build_fixture(const char *root, int size, bool *block_nodes)
+{
+    static const char *by_dirs[] = {"by-uuid", "by-label", "by-partuuid", "by-id", "by-path"};
+    char path[MAX_ROOTED_PATH_LENGTH];
+    char gvfs[MAX_GVFS_PATH_LENGTH];
+    snprintf(gvfs, sizeof(gvfs), GVFS_BASE_PATH, getuid());
+    if (!make_fixture_dir(root, "/proc/1") || !make_fixture_dir(root, gvfs))
+        return false;
+    for (size_t i = 0; i < sizeof(by_dirs) / sizeof(by_dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", DISK_BY_DIR, by_dirs[i]);
+        if (!make_fixture_dir(root, path))
+            return false;
+    }
+
+    static const char *clouds[] = {"google-drive:host=example.com,user=bench",
+                                   "onedrive:host=example.com,user=bench", "dropbox:host=bench"};
+    for (size_t i = 0; i < sizeof(clouds) / sizeof(clouds[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", gvfs, clouds[i]);
+        if (!make_fixture_dir(root, path))
+            return false;
+    }
+
+    snprintf(path, sizeof(path), "%s%s", root, ROOT_MOUNT_TABLE_PATH);
+    FILE *table = fopen(path, "w");
+    if (!table)
+        return false;
+
+    // Without CAP_MKNOD the disks are plain files; their udev lookup then
+    // stops at the stat() and the udev phase measures little
+    *block_nodes = true;
+    for (int i = 0; i < size; i++)
+    {
+        int disk = i / 10;
+        int id = i + 100;
+        char dir[MAX_PATH_LENGTH];
+        switch (i % 10)
+        {
+            case 0:
+                snprintf(dir, sizeof(dir), "/mnt/disk%d", disk);
+                fprintf(table, "%d 1 %d:%d / %s rw,relatime shared:%d - %s /dev/sda%d rw%s\n", id,
+                        BENCH_DEV_MAJOR, disk, dir, id, disk % 2 ? "xfs" : "ext4", disk,
+                        disk % 2 ? ",attr2,inode64,noquota" : ",errors=remount-ro");
+                if (!make_fixture_dir(root, dir))
+                    break;
+
+                snprintf(path, sizeof(path), "%s/dev/sda%d", root, disk);
+                if (!*block_nodes || mknod(path, S_IFBLK | 0600, makedev(BENCH_DEV_MAJOR, disk)) != 0)
+                {
+                    *block_nodes = false;
+                    close(open(path, O_CREAT | O_WRONLY | O_CLOEXEC, 0600));
+                }
+
+                char target[64];
+                snprintf(target, sizeof(target), "../../sda%d", disk);
+                for (size_t d = 0; d < sizeof(by_dirs) / sizeof(by_dirs[0]); d++)
+                {
+                    snprintf(path, sizeof(path), "%s%s/%s/bench-%08x-%d", root, DISK_BY_DIR, by_dirs[d],
+                             (unsigned int)disk * 2654435761u, disk);
+                    if (symlink(target, path) != 0 && errno != EEXIST)
+                        break;
+                }
+                break;
+            case 1:
+            case 2:
+                fprintf(table, "%d 1 %d:%d /srv/%d /srv/bind%d rw,nosuid,relatime shared:%d - %s /dev/sda%d rw\n",
+                        id, BENCH_DEV_MAJOR, disk, i, i, id, disk % 2 ? "xfs" : "ext4", disk);
+                break;
+            case 3:
+                snprintf(dir, sizeof(dir), "/net/share%d", i);
+                fprintf(table, "%d 1 0:%d / %s rw,relatime shared:%d - nfs4 server%d:/export/%d "
+                               "rw,vers=4.2,rsize=1048576,wsize=1048576,hard,proto=tcp,timeo=600\n",
+                        id, BENCH_NET_MINOR + i, dir, id, i % 7, i);
+                make_fixture_dir(root, dir);
+                break;
+            case 4:
+            case 5:
+                fprintf(table, "%d 1 0:%d / /var/lib/docker/overlay2/%08x/merged rw,relatime - overlay overlay "
+                               "rw,lowerdir=/var/lib/docker/overlay2/l/A:/var/lib/docker/overlay2/l/B,"
+                               "upperdir=/var/lib/docker/overlay2/%08x/diff\n",
+                        id, BENCH_NET_MINOR + i, i * 2654435761u, i * 2654435761u);
+                break;
+            case 6:
+                fprintf(table, "%d 1 0:%d / /run/netns/ns%d rw,nosuid,nodev,noexec,relatime - proc proc rw\n", id,
+                        BENCH_NET_MINOR + i, i);
+                break;
+            case 7:
+                fprintf(table, "%d 1 0:%d / /run/containers/%d/shm rw,nosuid,nodev - tmpfs shm rw,size=65536k\n", id,
+                        BENCH_NET_MINOR + i, i);
+                break;
+            case 8:
+                fprintf(table, "%d 1 0:%d /kubepods/pod%d /sys/fs/cgroup/pod%d rw,nosuid,nodev,noexec - cgroup2 "
+                               "cgroup2 rw,nsdelegate\n",
+                        id, BENCH_NET_MINOR + i, i, i);
+                break;
+            default:
+                fprintf(table, "%d 1 7:%d / /snap/app%d/%d ro,nodev,relatime shared:%d - squashfs /dev/loop%d ro\n",
+                        id, i, i, i % 100, id, i);
+                break;
+        }
+    }
+    return fclose(table) == 0;
+}
+
+// Helper: nftw() callback removing one fixture file
+int remove_fixture_entry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// Function to run the pipeline BENCH_ROUNDS times, keeping the best time of
+// each phase. Returns the number of drives reported.
+int bench_pipeline(double best_ms[PHASE_COUNT])
+{
+    for (int p = 0; p < PHASE_COUNT; p++)
+        best_ms[p] = -1;
+
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    drive_table_t drives = {0};
+    layout_t layout = compute_layout(TERM_FALLBACK_WIDTH);
+    int drive_count = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        long long elapsed[PHASE_COUNT];
+        long long start = now_ns();
+#define END_PHASE(phase)                   \
+    do                                     \
+    {                                      \
+        long long end = now_ns();          \
+        elapsed[phase] = end - start;      \
+        start = end;                       \
+    } while (0)
+
+        mount_table_t table;
+        if (!read_mount_table(&table, NULL, 0))
+        {
+            perror("Error reading the fixture mount table");
+            break;
+        }
+        END_PHASE(PHASE_PARSE);
+
+        probe_job_t *jobs = NULL;
+        int job_count = 0, job_capacity = 0;
+        add_mount_table_jobs(&table, &jobs, &job_count, &job_capacity);
+        free_mount_table(&table);
+        END_PHASE(PHASE_FILTER);
+
+        add_cloud_storage_jobs(&jobs, &job_count, &job_capacity);
+        END_PHASE(PHASE_GVFS);
+
+        group_mount_jobs(jobs, &job_count);
+        END_PHASE(PHASE_GROUP);
+
+        disk_index_reset(&disk_index);
+        disk_index_load(&disk_index);
+        END_PHASE(PHASE_UDEV);
+
+        probe_job_t *results = run_probes(jobs, job_count, NULL, NULL);
+        END_PHASE(PHASE_PROBE);
+
+        clear_drive_table(&drives);
+        for (int i = 0; results && i < job_count; i++)
+        {
+            if (results[i].state != PROBE_DONE && results[i].state != PROBE_TIMEOUT)
+                continue;
+            if (!add_probed_drive(&drives, &results[i]))
+                break;
+        }
+        free(results);
+        free_mount_jobs(jobs, job_count);
+        END_PHASE(PHASE_TABLE);
+
+        sort_drives(&drives);
+        END_PHASE(PHASE_SORT);
+
+        strbuf_t report = {0};
+        render_text_report(&report, &drives, &layout);
+        strbuf_free(&report);
+        END_PHASE(PHASE_TEXT);
+
+        // The JSON writer prints to stdout, which goes to /dev/null meanwhile
+        fflush(stdout);
+        int saved_stdout = dup(STDOUT_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        start = now_ns();
+        print_json(&drives);
+        fflush(stdout);
+        END_PHASE(PHASE_JSON);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+#undef END_PHASE
+
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            double ms = (double)elapsed[p] / NS_PER_MS;
+            if (best_ms[p] < 0 || ms < best_ms[p])
+                best_ms[p] = ms;
+        }
+        drive_count = drives.count;
+    }
+    free_drive_table(&drives);
+    disk_index_reset(&disk_index);
+    close(null_fd);
+    return drive_count;
+}
+
+// Function to read "SIZE PHASE MILLISECONDS" lines; a missing file is empty
+int load_baseline(const char *path, baseline_entry_t *entries)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+    int count = 0;
+    char line[256];
+    while (count < MAX_BASELINE_ENTRIES && fgets(line, sizeof(line), file))
+    {
+        baseline_entry_t *entry = &entries[count];
+        if (line[0] != '#' && sscanf(line, "%d %15s %lf", &entry->size, entry->phase, &entry->ms) == 3)
+            count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Helper: baseline time of one phase, or -1 if it has none
+double baseline_ms(const baseline_entry_t *entries, int count, int size, const char *phase)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (entries[i].size == size && strcmp(entries[i].phase, phase) == 0)
+            return entries[i].ms;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    bool update = false;
+    const char *baseline_path = DEFAULT_BASELINE;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--update") == 0)
+            update = true;
+        else
+            baseline_path = argv[i];
+    }
+
+    static baseline_entry_t baseline[MAX_BASELINE_ENTRIES];
+    int baseline_count = update ? 0 : load_baseline(baseline_path, baseline);
+    FILE *updated = NULL;
+    if (update)
+    {
+        updated = fopen(baseline_path, "w");
+        if (!updated)
+        {
+            perror("Cannot write the baseline");
+            return 1;
+        }
+        fprintf(updated, "# drinfo bench baseline: entries phase milliseconds (best of %d rounds)\n", BENCH_ROUNDS);
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    int regressions = 0;
+    for (size_t s = 0; s < sizeof(table_sizes) / sizeof(table_sizes[0]); s++)
+    {
+        int size = table_sizes[s];
+        char root[MAX_PATH_LENGTH];
+        snprintf(root, sizeof(root), "%s/drinfo-bench-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp");
+        if (!mkdtemp(root))
+        {
+            perror("Cannot create the fixture root");
+            return 1;
+        }
+
+        bool block_nodes;
+        long long setup_start = now_ns();
+        bool built = build_fixture(root, size, &block_nodes);
+        double setup_ms = (double)(now_ns() - setup_start) / NS_PER_MS;
+        double best_ms[PHASE_COUNT];
+        int drive_count = 0;
+        if (built)
+        {
+            snprintf(system_root, sizeof(system_root), "%s", root);
+            drive_count = bench_pipeline(best_ms);
+            system_root[0] = '\0';
+        }
+        nftw(root, remove_fixture_entry, 16, FTW_DEPTH | FTW_PHYS);
+        if (!built)
+        {
+            perror("Cannot build the fixture");
+            return 1;
+        }
+
+        printf("%d mount entries, %d drives (fixture %.0f ms%s)\n", size, drive_count, setup_ms,
+               block_nodes ? "" : ", no block nodes");
+        double total_ms = 0;
+        for (int p = 0; p < PHASE_COUNT; p++)
+        {
+            total_ms += best_ms[p];
+            double base = baseline_ms(baseline, baseline_count, size, phase_names[p]);
+            bool regressed = base >= 0 && best_ms[p] > base * REGRESSION_FACTOR &&
+                             best_ms[p] - base >= REGRESSION_MIN_MS;
+            if (base >= 0)
+                printf("  %-8s %10.3f ms  baseline %10.3f ms  %5.2fx%s\n", phase_names[p], best_ms[p], base,
+                       base > 0 ? best_ms[p] / base : 1.0, regressed ? "  REGRESSION" : "");
+            else
+                printf("  %-8s %10.3f ms\n", phase_names[p], best_ms[p]);
+            if (regressed)
+                regressions++;
+            if (updated)
+                fprintf(updated, "%d %s %.3f\n", size, phase_names[p], best_ms[p]);
+        }
+        printf("  %-8s %10.3f ms\n", "total", total_ms);
+    }
+
+    if (updated)
+    {
+        if (fclose(updated) != 0)
+        {
+            perror("Cannot write the baseline");
+            return 1;
+        }
+        printf("Baseline written to %s\n", baseline_path);
+    }
+    else if (!baseline_count)
+    {
+        printf("No baseline in %s; run 'make bench-baseline' to record one\n", baseline_path);
+    }
+    else if (regressions)
+    {
+        printf("%d phase(s) slower than %.1fx the baseline\n", regressions, REGRESSION_FACTOR);
+        return 1;
+    }
+    return 0;
+}
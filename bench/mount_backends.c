@@ -0,0 +1,124 @@
+// Benchmark comparing the procfs and listmount()/statmount() mount table
+// backends. As root it first grows the mount table with tmpfs mounts in a
+// private mount namespace, so the host is left untouched.
+//
+// Usage: bench/mount_backends [EXTRA_MOUNTS] (default 1000)
+
+#define main drinfo_main
+#include "../main.c"
+#undef main
+
+#include <sched.h>
+#include <sys/mount.h>
+
+#define DEFAULT_EXTRA_MOUNTS 1000
+#define BENCH_MIN_NS (500LL * NS_PER_MS) // Run each case for at least this long
+#define REFRESH_MOUNTS 8                 // Mounts looked up by the filtered case
+
+// Helper: monotonic time in nanoseconds
+long long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * NS_PER_SECOND + ts.tv_nsec;
+}
+
+// Function to add extra tmpfs mounts below a scratch directory
+int grow_mount_table(int extra)
+{
+    if (unshare(CLONE_NEWNS) != 0 || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0)
+    {
+        perror("Cannot create a private mount namespace, using the current table");
+        return 0;
+    }
+
+    char base[] = "/tmp/drinfo-bench-XXXXXX";
+    if (!mkdtemp(base) || mount("bench", base, "tmpfs", 0, "size=1m") != 0)
+    {
+        perror("Cannot create the scratch mount");
+        return 0;
+    }
+
+    int added = 0;
+    for (int i = 0; i < extra; i++)
+    {
+        char path[MAX_PATH_LENGTH];
+        snprintf(path, sizeof(path), "%s/m%d", base, i);
+        if (mkdir(path, 0755) != 0 || mount("bench", path, "tmpfs", MS_NOSUID | MS_NODEV, "size=64k") != 0)
+            break;
+        added++;
+    }
+    return added;
+}
+
+// Function to time reading the table (or only some of its mounts) with one backend
+void bench_backend(const char *name, mount_backend_t backend, const uint64_t *ids, int id_count)
+{
+    mount_backend = backend;
+    long long start = now_ns();
+    long long elapsed = 0;
+    int runs = 0;
+    int mounts = 0;
+    while (elapsed < BENCH_MIN_NS)
+    {
+        mount_table_t table;
+        if (!read_mount_table(&table, ids, id_count))
+        {
+            printf("  %-28s unavailable (%s)\n", name, strerror(errno));
+            return;
+        }
+        mounts = table.count;
+        free_mount_table(&table);
+        runs++;
+        elapsed = now_ns() - start;
+    }
+    printf("  %-28s %6d mounts  %10.1f us/run  %8.0f ns/mount\n", name, mounts,
+           elapsed / 1000.0 / runs, (double)elapsed / runs / (mounts ? mounts : 1));
+}
+
+int main(int argc, char *argv[])
+{
+    int extra = argc > 1 ? atoi(argv[1]) : DEFAULT_EXTRA_MOUNTS;
+    int added = geteuid() == 0 && extra > 0 ? grow_mount_table(extra) : 0;
+    printf("Mount table backends (%d extra mounts)\n", added);
+
+    printf("Full table:\n");
+    bench_backend("procfs (mountinfo)", MOUNT_BACKEND_PROCFS, NULL, 0);
+    bench_backend("listmount/statmount", MOUNT_BACKEND_STATMOUNT, NULL, 0);
+
+    // A watch-mode refresh only needs the mounts it shows. Each backend
+    // has its own IDs, so take the first few of each.
+    printf("Refresh of %d mounts:\n", REFRESH_MOUNTS);
+    mount_table_t table;
+    mount_backend = MOUNT_BACKEND_PROCFS;
+    if (read_mount_table(&table, NULL, 0) && table.count >= REFRESH_MOUNTS)
+    {
+        uint64_t ids[REFRESH_MOUNTS];
+        for (int i = 0; i < REFRESH_MOUNTS; i++)
+            ids[i] = table.entries[i].unique_id;
+        qsort(ids, REFRESH_MOUNTS, sizeof(uint64_t), compare_mount_ids);
+        bench_backend("procfs (mountinfo)", MOUNT_BACKEND_PROCFS, ids, REFRESH_MOUNTS);
+    }
+    free_mount_table(&table);
+
+    // Watch mode also lists all IDs to find new mounts
+    long long start = now_ns();
+    int runs = 0;
+    while (now_ns() - start < BENCH_MIN_NS)
+    {
+        uint64_t *ids;
+        if (list_mount_ids(&ids) < 0)
+            break;
+        free(ids);
+        runs++;
+    }
+    if (runs)
+        printf("  %-28s %10.1f us/run\n", "listmount (IDs only)", (now_ns() - start) / 1000.0 / runs);
+
+    uint64_t *ids;
+    int id_count = list_mount_ids(&ids);
+    if (id_count >= REFRESH_MOUNTS)
+        bench_backend("listmount/statmount", MOUNT_BACKEND_STATMOUNT, ids, REFRESH_MOUNTS);
+    free(ids);
+    return 0;
+}
@@ -3,7 +3,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/statvfs.h>
-#include <mntent.h>
 #include <unistd.h>
 #include <regex.h>
 #include <sys/ioctl.h>
@@ -15,6 +14,27 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <stddef.h>
+#include <spawn.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <grp.h>
 
 // Constants for terminal and display
 #define TERM_FALLBACK_WIDTH 80
@@ -35,11 +55,11 @@
 
 // Constants for file paths and buffers
 #define MAX_PATH_LENGTH 1024
+#define MAX_ROOTED_PATH_LENGTH (2 * MAX_PATH_LENGTH) // A path below system_root
 #define MAX_GVFS_PATH_LENGTH 256
 #define MAX_SIZE_STR_LENGTH 64
 #define MAX_PERCENT_TEXT_LENGTH 16
 #define MAX_TEMP_BUFFER_LENGTH 128
-#define MAX_BAR_BUFFER_MULTIPLIER 64
 #define BARLINE_BUFFER_EXTRA 16
 
 // Constants for terminal width calculations
@@ -50,6 +70,77 @@
 #define FRAME_PADDING 4
 #define BRACKET_PADDING 2
 #define MIN_BAR_LENGTH 10
+#define MAX_BAR_LENGTH (MAX_BOX_WIDTH - FRAME_PADDING - BRACKET_PADDING)
+#define STRBUF_INITIAL_CAPACITY 1024
+
+// Constants for the JSON writer
+#define JSON_ONES 0x0101010101010101ULL  // 0x01 in every byte of a block
+#define JSON_HIGHS 0x8080808080808080ULL // 0x80 in every byte of a block
+#define MAX_DECIMAL_LENGTH 21           // Digits of a 64-bit integer, sign included
+#define MAX_FLOAT_LENGTH 32
+
+// Constants for --format cbor and msgpack
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_INLINE_MAX 23  // Larger arguments follow the initial byte
+#define CBOR_ARGUMENT_1 24  // Initial byte argument: 1, 2, 4 or 8 bytes follow
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT32 0xfa
+#define MSGPACK_FIXINT_MAX 0x7f
+#define MSGPACK_FIXMAP 0x80
+#define MSGPACK_FIXARRAY 0x90
+#define MSGPACK_FIXSTR 0xa0
+#define MSGPACK_NIL 0xc0
+#define MSGPACK_FALSE 0xc2
+#define MSGPACK_TRUE 0xc3
+#define MSGPACK_FLOAT32 0xca
+#define MSGPACK_UINT8 0xcc  // uint16, uint32 and uint64 follow
+#define MSGPACK_INT8 0xd0   // int16, int32 and int64 follow
+#define MSGPACK_STR8 0xd9   // str16 and str32 follow
+#define MSGPACK_ARRAY16 0xdc
+#define MSGPACK_MAP16 0xde
+#define MSGPACK_NEGATIVE_FIXINT_MIN (-32)
+
+// Constants for --format prometheus
+#define PROBE_LATENCY_BUCKET_COUNT 8
+#define OUTPUT_FILE_MODE 0644
+
+// Constants for --daemon snapshots
+#define DEFAULT_SNAPSHOT_PATH "/run/drinfo.snapshot"
+#define DEFAULT_DAEMON_INTERVAL 10     // Seconds between refreshes without -w
+#define SNAPSHOT_MAGIC 0x64726e66      // "fnrd" in memory on little-endian hosts
+#define SNAPSHOT_VERSION 2             // Bumped whenever the header or payload layout changes
+#define SNAPSHOT_MIN_CAPACITY 65536    // Payload bytes of a new snapshot file, doubled as needed
+#define SNAPSHOT_READ_ATTEMPTS 1000    // Seqlock retries before falling back to a scan
+#define SNAPSHOT_STALE_INTERVALS 3     // Older than this many refreshes plus a scan means the daemon is stuck
+#define SNAPSHOT_SCOPE_WHERE 0x01      // Drives left out by --where or --exclude-type
+#define SNAPSHOT_SCOPE_TOP 0x02        // Only the --top N drives
+#define SNAPSHOT_SCOPE_ROOT 0x04       // The mounts of --root, not of this host
+#define SNAPSHOT_SCOPE_NO_DEDUP 0x08   // Bind mounts as drives of their own
+
+// Constants for the --daemon query socket
+#define DEFAULT_SOCKET_PATH "/run/drinfo.sock"
+#define DEFAULT_SOCKET_MODE 0660       // Owner and --socket-group may ask
+#define QUERY_LENGTH_BYTES 4           // Big-endian length in front of every frame
+#define QUERY_MAX_REQUEST 65536        // Longer requests close the connection
+#define QUERY_MAX_PENDING (4 << 20)    // Unsent response bytes a client may pile up
+#define QUERY_LISTEN_BACKLOG 128
+#define QUERY_READ_CHUNK 4096
+#define WATCH_MAX_EVENTS 64
+#define QUERY_STATUS_OK 0
+#define QUERY_STATUS_ERROR 1
+
+// Constants for the drive table
+#define DRIVE_TABLE_INITIAL_CAPACITY 16
+#define ARENA_BLOCK_SIZE 16384      // Strings are copied into blocks of this size
+#define INTERN_INITIAL_CAPACITY 64  // Slots in the interned string set, doubled at 70% load
+#define BAR_FILLED_CHAR "█"
+#define BAR_EMPTY_CHAR "░"
 
 // Constants for color values
 #define MAX_COLOR_VALUE 255
@@ -73,16 +164,182 @@
 #define RESET_FORMAT "\033[0m"
 
 // Constants for file system types
-#define MOUNT_TABLE_PATH "/proc/mounts"
+#define MOUNT_TABLE_PATH "/proc/self/mountinfo"
+#define ROOT_MOUNT_TABLE_PATH "/proc/1/mountinfo" // Below --root: the mounts of its init, not ours
+#define MOUNT_TABLE_READ_SIZE 65536 // Initial read buffer, doubled as needed
+
+// Constants for the listmount()/statmount() mount table backend (Linux 6.8+)
+#ifndef SYS_statmount
+#define SYS_statmount 457
+#endif
+#ifndef SYS_listmount
+#define SYS_listmount 458
+#endif
+#define LIST_MOUNT_ROOT UINT64_MAX      // LSMT_ROOT: every mount of the namespace
+#define MOUNT_ID_REQUEST_SIZE 24        // MNT_ID_REQ_SIZE_VER0
+#define LIST_MOUNT_BATCH 4096           // Mount IDs fetched per listmount() call
+#define STATMOUNT_BUFFER_SIZE 4096      // Initial statmount() buffer, doubled on EOVERFLOW
+#define STATMOUNT_SB_BASIC 0x0001
+#define STATMOUNT_MNT_BASIC 0x0002
+#define STATMOUNT_PROPAGATE_FROM 0x0004
+#define STATMOUNT_MNT_ROOT 0x0008
+#define STATMOUNT_MNT_POINT 0x0010
+#define STATMOUNT_FS_TYPE 0x0020
+#define STATMOUNT_MNT_OPTS 0x0080
+#define STATMOUNT_FS_SUBTYPE 0x0100
+#define STATMOUNT_SB_SOURCE 0x0200
+#define STATMOUNT_WANTED (STATMOUNT_SB_BASIC | STATMOUNT_MNT_BASIC | STATMOUNT_PROPAGATE_FROM | \
+                          STATMOUNT_MNT_ROOT | STATMOUNT_MNT_POINT | STATMOUNT_FS_TYPE | \
+                          STATMOUNT_MNT_OPTS | STATMOUNT_FS_SUBTYPE | STATMOUNT_SB_SOURCE)
+#define MOUNT_ATTR_RDONLY_FLAG 0x00000001
+#define MOUNT_ATTR_NOSUID_FLAG 0x00000002
+#define MOUNT_ATTR_NODEV_FLAG 0x00000004
+#define MOUNT_ATTR_NOEXEC_FLAG 0x00000008
+#define MOUNT_ATTR_ATIME_MASK 0x00000070
+#define MOUNT_ATTR_NOATIME_FLAG 0x00000010
+#define MOUNT_ATTR_STRICTATIME_FLAG 0x00000020
+#define MOUNT_ATTR_NODIRATIME_FLAG 0x00000080
+#define MOUNT_ATTR_NOSYMFOLLOW_FLAG 0x00200000
+#define SB_RDONLY_FLAG 0x00000001
+#define SB_SYNCHRONOUS_FLAG 0x00000010
+#define SB_DIRSYNC_FLAG 0x00000080
+#define SB_LAZYTIME_FLAG 0x02000000
+#define PROPAGATION_UNBINDABLE (1 << 17)
+#define PROPAGATION_SLAVE (1 << 19)
+#define PROPAGATION_SHARED (1 << 20)
 #define GVFS_BASE_PATH "/run/user/%d/gvfs"
 
-// Maximum number of drives to handle
-#define MAX_DRIVES 100
+// Constants for the statvfs probe engine
+#define PROBE_POOL_SIZE 8
+#define PROBE_MAX_THREADS 32
+#define DEFAULT_PROBE_TIMEOUT_MS 5000
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000L
+#define NS_PER_SECOND 1000000000L
+#define NS_PER_US 1000L
+#define US_PER_SECOND 1000000L
+#define MAX_ABANDONED_HELPERS 64
+#define HELPER_MAX_FD 65536            // Last resort when neither close_range() nor /proc works
+#define SELF_FD_DIR "/proc/self/fd"
+#define SELF_FD_READ_SIZE 4096
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
+// Constants for the udev symlink index
+#define DISK_BY_DIR "/dev/disk"
+#define DISK_INDEX_INITIAL_CAPACITY 64
+#define DISK_INDEX_MAX_LOAD_PERCENT 70
+#define MAX_DISK_ID_LENGTH (NAME_MAX + 1)
+
+// Constants for the built-in superblock reader
+#define SB_HEAD_SIZE 4096         // XFS, FAT, exFAT, ext2/3/4 and swap live in here
+#define SB_EXT_OFFSET 1024
+#define SB_EXT_MAGIC 0xEF53
+#define SB_BTRFS_OFFSET 0x10000
+#define SB_BTRFS_SIZE 0x200
+#define SB_SWAP_SIGNATURE_LENGTH 10
+#define SB_EXFAT_MAX_ROOT_READ 4096
+#define SB_UUID_BYTES 16
+#define MAX_FS_TYPE_LENGTH 16
+
+// Constants for SMART collection
+#define SMART_MAX_PARALLEL 8
+#define SMART_CACHE_DIR "/var/cache/drinfo"
+#define DEFAULT_SMART_TTL 300
+#define SMART_READ_CHUNK 4096
+#define SMART_OUTPUT_LIMIT (4 * 1024 * 1024)
+#define SMART_UNKNOWN -1
+#define MAX_SMART_STATUS_LENGTH 32
+#define SYS_CLASS_BLOCK "/sys/class/block"
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define MAX_BOOT_ID_LENGTH 64
+#define MAX_JSON_PATH_LENGTH 256
+#define MAX_JSON_DEPTH 32
+#define MAX_JSON_STRING_LENGTH 256     // Longer string values are cut for the visitor
+
+// Constants for sorting
+#define MAX_SORT_KEYS 8
+
+// Constants for --where
+#define WHERE_INITIAL_CAPACITY 16
+#define MAX_WHERE_FIELD_LENGTH 16
+#define MAX_WHERE_VALUE_LENGTH 256
+
+// Constants for the PATH resolver
+#define MOUNT_TRIE_INITIAL_SLOTS 64
+#define MOUNT_TRIE_MAX_LOAD_PERCENT 70
+
+// Constants for --profile
+#define PROFILE_SLOWEST_MOUNTS 10
+#define SYSCALL_TRACEPOINT_ID "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id"
+#define SYSCALL_TRACEPOINT_ID_DEBUGFS "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
 
 // Global options
-bool opt_json = false;
+typedef enum { FORMAT_TEXT, FORMAT_JSON, FORMAT_CBOR, FORMAT_MSGPACK, FORMAT_PROMETHEUS } output_format_t;
+output_format_t opt_format = FORMAT_TEXT;      // --format; -j is --format json
+const char *opt_output = NULL;                 // --output: file replaced atomically with each report
+bool output_failed = false;                    // A report could not be written to --output
+bool opt_daemon = false;                       // Publish snapshots for other drinfo runs instead of reports
+bool opt_no_snapshot = false;                  // Always scan, even if a daemon publishes a snapshot
+const char *opt_snapshot = DEFAULT_SNAPSHOT_PATH;
+const char *opt_socket = DEFAULT_SOCKET_PATH;  // Query socket of --daemon, "" = none
+mode_t opt_socket_mode = DEFAULT_SOCKET_MODE;
+gid_t opt_socket_group = (gid_t)-1;            // Group of the query socket, -1 = that of the daemon
 bool opt_no_color = false;
-enum { SORT_SIZE, SORT_USAGE, SORT_MOUNT, SORT_NAME } opt_sort = SORT_SIZE;
+typedef enum { SORT_SIZE, SORT_USAGE, SORT_MOUNT, SORT_NAME } sort_field_t;
+typedef struct
+{
+    sort_field_t field;
+    bool reverse; // "-key": smallest size/usage first, or Z-A
+} sort_key_t;
+sort_key_t opt_sort_keys[MAX_SORT_KEYS] = {{SORT_SIZE, false}}; // --sort, most significant first
+int opt_sort_key_count = 1;
+int opt_top = 0;                               // Keep only the first N drives after sorting, 0 = all
+enum
+{
+    FIELD_DEVICE = 1 << 0,
+    FIELD_MOUNT = 1 << 1,
+    FIELD_FILESYSTEM = 1 << 2,
+    FIELD_SIZE = 1 << 3,
+    FIELD_USED = 1 << 4,
+    FIELD_AVAILABLE = 1 << 5,
+    FIELD_USAGE = 1 << 6,
+    FIELD_TYPE = 1 << 7,
+    FIELD_UUID = 1 << 8,
+    FIELD_LABEL = 1 << 9,
+    FIELD_PARTUUID = 1 << 10,
+    FIELD_DISK_ID = 1 << 11,
+    FIELD_DISK_PATH = 1 << 12,
+    FIELD_OPTIONS = 1 << 13,
+    FIELD_INODES = 1 << 14,
+    FIELD_SMART = 1 << 15,
+    FIELD_STATE = 1 << 16,
+    FIELD_ALL = (1 << 17) - 1,
+    FIELDS_DISK_IDS = FIELD_UUID | FIELD_LABEL | FIELD_PARTUUID | FIELD_DISK_ID | FIELD_DISK_PATH
+};
+unsigned int opt_fields = FIELD_ALL;           // Output columns; the collectors of the others are skipped
+const struct
+{
+    const char *name;
+    unsigned int mask;
+} field_names[] = {
+    {"device", FIELD_DEVICE}, {"mount", FIELD_MOUNT}, {"fs", FIELD_FILESYSTEM}, {"size", FIELD_SIZE},
+    {"used", FIELD_USED}, {"avail", FIELD_AVAILABLE}, {"use", FIELD_USAGE}, {"type", FIELD_TYPE},
+    {"uuid", FIELD_UUID}, {"label", FIELD_LABEL}, {"partuuid", FIELD_PARTUUID}, {"diskid", FIELD_DISK_ID},
+    {"diskpath", FIELD_DISK_PATH}, {"options", FIELD_OPTIONS}, {"inodes", FIELD_INODES}, {"smart", FIELD_SMART},
+    {"state", FIELD_STATE}, {"all", FIELD_ALL}};
+int opt_timeout_ms = DEFAULT_PROBE_TIMEOUT_MS; // Per-mount statvfs deadline, 0 = none
+int opt_deadline_ms = 0;                       // Global probe budget, 0 = none
+int opt_smart_ttl = DEFAULT_SMART_TTL;         // Seconds to reuse cached SMART data, 0 = off
+int opt_watch_seconds = 0;                     // Refresh interval of --watch, 0 = run once
+bool opt_events = false;                       // Stream mount table changes instead of a report
+bool opt_no_dedup = false;                     // List bind mounts as separate drives
+bool opt_ndjson = false;                       // Stream one JSON line per drive as it is probed
+bool opt_profile = false;                      // Report time and syscalls per phase
+const char *opt_paths_from = NULL;             // File with paths to resolve, "-" = stdin
+char system_root[MAX_PATH_LENGTH] = "";        // --root: prefix for system paths and mount points, "" = /
+enum { ISOLATE_NONE, ISOLATE_NETWORK, ISOLATE_ALL } opt_isolate = ISOLATE_NONE;
 
 // Color strings (can be disabled)
 const char *c_bold_yellow = "\033[1;33m";
@@ -95,88 +352,706 @@ const char *skip_filesystems[] = {
     "tracefs", "configfs", "fusectl", "fuse.gvfsd-fuse", "binfmt_misc",
     "fuse.portal"};
 
-// Structure to hold drive information
+// SMART data of a whole disk, as reported by smartctl -j
 typedef struct
 {
-    char mount_point[MAX_PATH_LENGTH];
-    char filesystem[MAX_SIZE_STR_LENGTH];
-    char device[MAX_PATH_LENGTH];
-    char uuid[128];
-    char label[128];
-    char total_str[MAX_SIZE_STR_LENGTH];
-    char used_str[MAX_SIZE_STR_LENGTH];
-    char available_str[MAX_SIZE_STR_LENGTH];
-    unsigned long long total_bytes;
-    unsigned long long used_bytes;
-    unsigned long long available_bytes;
-    double usage_percent;
+    char status[MAX_SMART_STATUS_LENGTH]; // PASSED, FAILED or empty if unknown
+    long long temperature;                // Degrees Celsius
+    long long power_on_hours;
+    long long percentage_used;            // Wear: NVMe percentage used or ATA wear attributes
+    long long reallocated_sectors;
+} smart_info_t;
+
+// One block of an arena; blocks are chained newest first
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+} arena_block_t;
+
+// Per-run string storage. Strings are copied into large blocks that are
+// released together; values that repeat across drives (filesystem types,
+// mount options) are interned so all drives share one copy.
+typedef struct
+{
+    arena_block_t *blocks;
+    const char **interned;    // Open-addressing set of interned strings
+    size_t interned_capacity; // Power of two
+    size_t interned_count;
+} string_arena_t;
+
+// Descriptive part of a drive; strings live in the drive table's arena and
+// are "" when unknown
+typedef struct
+{
+    const char *mount_point;
+    const char *filesystem;    // Interned
+    const char *device;
+    const char *uuid;
+    const char *label;
+    const char *partuuid;
+    const char *disk_id;       // Name under /dev/disk/by-id
+    const char *disk_path;     // Name under /dev/disk/by-path
+    const char *mount_options; // Interned
     const char *drive_type;
-    char *progress_bar;
+    const char *cloud_service_name;
+    const char **bind_mounts;  // Other mount points of the same filesystem
+    int bind_mount_count;
     bool is_cloud_storage;
-    char cloud_service_name[MAX_SIZE_STR_LENGTH];
+    bool timed_out; // statvfs did not answer within the deadline
+    bool has_smart; // SMART was queried for the disk holding this drive
+    smart_info_t smart;
+    const char *path; // Path asked for with drinfo PATH..., NULL otherwise
+} drive_info_t;
+
+// Drives found in one run, stored by column: the numbers that are sorted
+// and summed sit in compact arrays, the rest in info. All columns share
+// one allocation that grows with the number of mounts.
+typedef struct
+{
+    int count;
+    int capacity;
+    void *block; // Backing memory of all columns
+    unsigned long long *total_bytes;
+    unsigned long long *used_bytes;
+    unsigned long long *available_bytes;
+    unsigned long long *total_inodes;
+    unsigned long long *used_inodes;
+    double *usage_percent;
+    double *inode_usage;
+    drive_info_t *info;
+    uint32_t *order; // Display order; sort_drives() permutes it
+    string_arena_t strings;
+} drive_table_t;
+
+// Names udev published for one block device under /dev/disk/by-*
+typedef struct
+{
+    dev_t rdev;
+    bool used;
+    char uuid[MAX_DISK_ID_LENGTH];
+    char label[MAX_DISK_ID_LENGTH];
+    char partuuid[MAX_DISK_ID_LENGTH];
+    char disk_id[MAX_DISK_ID_LENGTH];
+    char disk_path[MAX_DISK_ID_LENGTH];
+    bool superblock_read; // Fallback superblock probe already attempted
+} disk_ids_t;
+
+// Identity of a filesystem as read from its superblock
+typedef struct
+{
+    char type[MAX_FS_TYPE_LENGTH];
+    char uuid[MAX_DISK_ID_LENGTH];
+    char label[MAX_DISK_ID_LENGTH];
+} superblock_ids_t;
+
+// Open-addressing hash map from dev_t to disk_ids_t, built once per run
+typedef struct
+{
+    disk_ids_t *slots;
+    size_t capacity; // Always a power of two
+    size_t count;
+    bool loaded;
+} disk_index_t;
+
+// Lifecycle of a single statvfs probe
+typedef enum
+{
+    PROBE_PENDING,
+    PROBE_RUNNING,
+    PROBE_DONE,
+    PROBE_FAILED,
+    PROBE_TIMEOUT
+} probe_state_t;
+
+// A mount that passed the filters and is waiting to be probed
+typedef struct
+{
+    char mount_point[MAX_PATH_LENGTH];
+    char device[MAX_PATH_LENGTH];
+    char filesystem[MAX_SIZE_STR_LENGTH];
     char mount_options[MAX_TEMP_BUFFER_LENGTH];
-    unsigned long long total_inodes;
-    unsigned long long used_inodes;
+    const char *cloud_service_name; // NULL for entries from the mount table
+    bool isolated;                  // Probed in a forked helper process
+    uint64_t mount_id;              // unique_id of the mount table entry, 0 for cloud storage
+    dev_t dev;                      // Filesystem device number, 0 if unknown
+    bool fs_root;                   // The whole filesystem is mounted, not a subdirectory
+    char **bind_mounts;             // Other mount points of the same filesystem
+    int bind_mount_count;
+    probe_state_t state;
+    struct timespec started;
+    long long elapsed_us; // How long the probe took or ran until it was given up
+    struct statvfs fs_info;
+} probe_job_t;
+
+// Called from run_probes() for each job as soon as it is finished
+typedef void (*probe_done_fn)(const probe_job_t *job, int index, void *context);
+
+// One line of /proc/self/mountinfo. The strings point into the buffer of
+// the mount_table_t the entry belongs to.
+typedef struct
+{
+    uint64_t unique_id;    // 64-bit statmount() ID; equals mount_id with the procfs backend
+    int mount_id;
+    int parent_id;
+    unsigned int major;
+    unsigned int minor;
+    char *root;            // Path inside the filesystem that is mounted
+    char *mount_point;
+    char *mount_options;   // Per-mount options, e.g. "rw,relatime"
+    char *optional_fields; // Propagation tags, e.g. "shared:1 master:2"
+    char *fstype;
+    char *source;
+    char *super_options;   // Per-superblock options, e.g. "rw,errors=remount-ro"
+} mount_entry_t;
+
+// The whole mount table, read in one go and tokenized in place
+typedef struct
+{
+    char *buffer;
+    size_t length;
+    mount_entry_t *entries;
+    int count;
+} mount_table_t;
+
+// How the mount table is read
+typedef enum
+{
+    MOUNT_BACKEND_AUTO,      // listmount()/statmount() if the kernel has them, else procfs
+    MOUNT_BACKEND_STATMOUNT,
+    MOUNT_BACKEND_PROCFS
+} mount_backend_t;
+
+mount_backend_t mount_backend = MOUNT_BACKEND_AUTO;
+
+// Request for listmount() and statmount() (struct mnt_id_req)
+typedef struct
+{
+    uint32_t size;
+    uint32_t spare;
+    uint64_t mnt_id;
+    uint64_t param;
+} mount_id_request_t;
+
+// Fixed part of the statmount() result (struct statmount); string fields
+// are offsets into str
+typedef struct
+{
+    uint32_t size;
+    uint32_t mnt_opts;
+    uint64_t mask;
+    uint32_t sb_dev_major;
+    uint32_t sb_dev_minor;
+    uint64_t sb_magic;
+    uint32_t sb_flags;
+    uint32_t fs_type;
+    uint64_t mnt_id;
+    uint64_t mnt_parent_id;
+    uint32_t mnt_id_old;
+    uint32_t mnt_parent_id_old;
+    uint64_t mnt_attr;
+    uint64_t mnt_propagation;
+    uint64_t mnt_peer_group;
+    uint64_t mnt_master;
+    uint64_t propagate_from;
+    uint32_t mnt_root;
+    uint32_t mnt_point;
+    uint64_t mnt_ns_id;
+    uint32_t fs_subtype;
+    uint32_t sb_source;
+    uint64_t spare[48]; // Fields drinfo does not use; str starts at byte 512
+    char str[];
+} statmount_result_t;
+
+// Shared state of one probe run. Worker threads that hang in statvfs()
+// keep a reference, so the last one out frees it.
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    probe_job_t *jobs;
+    int count;
+    int next;     // Index of the next pending job
+    int finished; // Jobs in a final state
+    int threads;  // Worker threads started
+    int stuck;    // Workers whose job was given up on
+    int refs;     // Main thread + live workers
+    bool abandoned;
+    bool has_deadline;
+    struct timespec deadline; // Global deadline for the whole run
+} probe_pool_t;
+
+// A forked helper process that runs statvfs() on behalf of a worker thread
+typedef struct
+{
+    pid_t pid;
+    int request_fd;
+    int response_fd;
+} probe_helper_t;
+
+// Request and response records exchanged with a helper. Both are smaller
+// than PIPE_BUF, so every write() is atomic.
+typedef struct
+{
+    char path[MAX_ROOTED_PATH_LENGTH];
+} helper_request_t;
+
+typedef struct
+{
+    int rc;
+    struct statvfs fs_info;
+} helper_response_t;
+
+// Helpers that were killed but could not be reaped yet
+pid_t abandoned_helpers[MAX_ABANDONED_HELPERS];
+int abandoned_helper_count = 0;
+pthread_mutex_t abandoned_helpers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+disk_index_t disk_index = {0};
+
+// Phases of a report measured by --profile
+typedef enum
+{
+    PROFILE_PARSE,
+    PROFILE_FILTER,
+    PROFILE_GVFS,
+    PROFILE_DEDUP,
+    PROFILE_STATVFS,
+    PROFILE_DISK_IDS,
+    PROFILE_SMART,
+    PROFILE_SORT,
+    PROFILE_RENDER,
+    PROFILE_PHASE_COUNT
+} profile_phase_t;
+
+const char *profile_phase_names[PROFILE_PHASE_COUNT] = {
+    "mount_parse", "filter", "gvfs_scan", "dedup", "statvfs", "uuid_label", "smart", "sort", "render"};
+
+// One probed mount, for the list of the slowest ones
+typedef struct
+{
+    char mount_point[MAX_PATH_LENGTH];
+    long long elapsed_us;
+    probe_state_t state;
+} profile_mount_t;
+
+// Measurements of --profile. Syscalls are counted by a perf counter on the
+// raw_syscalls:sys_enter tracepoint, inherited by worker threads, helpers
+// and smartctl; without one (not root, no tracefs) only time is reported.
+typedef struct
+{
+    bool started;
+    int syscall_fd; // -1 if syscalls cannot be counted
+    long long phase_ns[PROFILE_PHASE_COUNT];
+    long long phase_syscalls[PROFILE_PHASE_COUNT];
+    profile_mount_t slowest[PROFILE_SLOWEST_MOUNTS]; // Slowest first
+    int slowest_count;
+    int mount_count;
+} profile_t;
+
+// Start of a measured stretch
+typedef struct
+{
+    long long ns;
+    long long syscalls;
+} profile_mark_t;
+
+profile_t profile = {.syscall_fd = -1};
+
+// Upper bounds of the probe latency histogram of --format prometheus
+const long long probe_latency_bounds_us[PROBE_LATENCY_BUCKET_COUNT] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000};
+
+// Probe latencies since start, cumulative like a Prometheus histogram
+typedef struct
+{
+    long long buckets[PROBE_LATENCY_BUCKET_COUNT]; // Probes that took at most the bound, not cumulative
+    long long count;
+    long long sum_us;
+} probe_latency_t;
+probe_latency_t probe_latency;
+
+// Fields a --where predicate can test. The string ones come from the mount
+// table; the numbers and the state are only known after statvfs().
+typedef enum
+{
+    WHERE_MOUNT,
+    WHERE_DEVICE,
+    WHERE_FSTYPE,
+    WHERE_OPTIONS,
+    WHERE_STATE,
+    WHERE_SIZE,
+    WHERE_USED,
+    WHERE_AVAILABLE,
+    WHERE_USAGE,
+    WHERE_INODE_USAGE
+} where_field_t;
+
+typedef enum
+{
+    WHERE_EQ,
+    WHERE_NE,
+    WHERE_MATCH,
+    WHERE_NO_MATCH,
+    WHERE_LT,
+    WHERE_LE,
+    WHERE_GT,
+    WHERE_GE
+} where_op_t;
+
+// One instruction of a compiled --where expression, in postfix order
+typedef struct
+{
+    enum { WHERE_COMPARE, WHERE_AND, WHERE_OR, WHERE_NOT } kind;
+    where_field_t field;
+    where_op_t op;
+    char *text;    // String operand
+    double number; // Numeric operand (bytes or percent)
+    regex_t regex; // Compiled operand of =~ and !~
+} where_node_t;
+
+// Three-valued result: predicates on probe results are unknown before the probe
+typedef enum
+{
+    WHERE_FALSE,
+    WHERE_TRUE,
+    WHERE_UNKNOWN
+} where_result_t;
+
+// The --where and --exclude-type filters, compiled into one program
+typedef struct
+{
+    where_node_t *nodes;
+    int count;
+    int capacity;
+    bool needs_probe;       // Some predicate tests a probe result
+    where_result_t *stack;  // Evaluation stack, one slot per node
+} where_program_t;
+
+// What the predicates look at: a mount before probing, a drive after
+typedef struct
+{
+    const char *mount_point;
+    const char *device;
+    const char *fstype;
+    const char *options;
+    bool probed;
+    bool timed_out;
+    double size;
+    double used;
+    double available;
+    double usage;
     double inode_usage;
-} drive_info_t;
+} where_subject_t;
+
+where_program_t where_program = {0}; // Empty: every mount passes
+
+// One path component in the mount trie. Names point into the mount table.
+typedef struct
+{
+    int parent;
+    const char *name;
+    size_t name_length;
+    int mount; // Index of the mount table entry mounted here, -1 if none
+} mount_trie_node_t;
+
+// Trie over the mount points of a mount table for longest-prefix lookups.
+// Edges live in one open-addressing hash keyed by (parent, name), so a
+// directory with thousands of mounts below it costs O(1) per step.
+typedef struct
+{
+    mount_trie_node_t *nodes; // nodes[0] is /
+    int count;
+    int capacity;
+    int *slots;          // Node index + 1, 0 = empty
+    size_t slot_count;   // Power of two
+} mount_trie_t;
+
+// Growable output buffer, always NUL-terminated; appends are amortized O(1)
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool failed; // An allocation failed; further appends are dropped
+} strbuf_t;
+
+// State of --ndjson output, passed to print_probed_drive() for every drive
+typedef struct
+{
+    drive_table_t table; // One row, reused for every drive
+    strbuf_t line;       // The JSON line being built, reused as well
+} ndjson_state_t;
+
+// Start of a --daemon snapshot file, which readers map. The payload follows
+// the header. sequence is a seqlock: the daemon makes it odd while it
+// rewrites the payload and even again when done, so a reader that saw the
+// same even value before and after copying has a consistent payload.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;
+    uint32_t daemon_pid;
+    uint32_t interval; // Seconds between refreshes
+    uint32_t scope;    // SNAPSHOT_SCOPE_* options that narrowed the daemon's table
+    uint32_t fields;   // --fields of the daemon; the others were not collected
+    uint32_t stale_after; // Seconds after updated the snapshot is no longer trusted
+    uint64_t capacity; // Payload bytes the file has room for
+    uint64_t length;   // Payload bytes in use
+    int64_t updated;   // Wall clock time of the last publish
+} snapshot_header_t;
+
+// Mapping of the snapshot file the daemon publishes to
+typedef struct
+{
+    snapshot_header_t *header;
+    size_t size; // Bytes mapped, header included
+    strbuf_t payload;
+} snapshot_writer_t;
+snapshot_writer_t snapshot_writer = {0};
+
+// One connection to the query socket
+typedef struct
+{
+    strbuf_t in;  // Received bytes not yet answered
+    strbuf_t out; // Responses not yet sent
+    size_t sent;  // Bytes at the start of out already sent
+} query_client_t;
+
+// One parsed request of the query socket
+typedef struct
+{
+    const char *mount;  // Selectors, NULL if not given
+    const char *device;
+    const char *uuid;
+    const char *path;
+    where_program_t filter;
+    unsigned int fields;
+    output_format_t format;
+} query_t;
+
+// Query socket of --daemon; clients are found by their descriptor
+typedef struct
+{
+    int listen_fd; // -1 if there is no socket
+    query_client_t **clients;
+    int client_capacity;
+    mount_trie_t mount_points; // Of the drives queries are answered from, for path=
+} query_server_t;
+
+// Read position in a snapshot payload
+typedef struct
+{
+    const char *cursor;
+    const char *end;
+    bool failed; // Ran past the end; the payload is unusable
+} snapshot_reader_t;
+
+// Escape sequences for every cell of a progress bar, built once per bar length
+typedef struct
+{
+    int length; // Bar length the table was built for, 0 = not built yet
+    char fg[MAX_BAR_LENGTH][COLOR_BUFFER_SIZE];
+    char bg[MAX_BAR_LENGTH][COLOR_BUFFER_SIZE];
+    unsigned char fg_length[MAX_BAR_LENGTH];
+    unsigned char bg_length[MAX_BAR_LENGTH];
+    char text[COLOR_BUFFER_SIZE];      // Percentage text on the filled part
+    char empty[2 * COLOR_BUFFER_SIZE]; // Unfilled part
+    unsigned char text_length;
+    unsigned char empty_length;
+} bar_palette_t;
+
+bar_palette_t bar_palette = {0};
+
+// Mount list kept between refreshes, reparsed only when the table changes
+typedef struct
+{
+    probe_job_t *jobs;
+    int job_count;
+    bool stale;        // The mount table changed (or was never read)
+    uint64_t *seen_ids; // Sorted IDs of all mounts at the last refresh
+    int seen_count;
+    uint64_t *reported_ids; // Sorted IDs of the mounts that passed the filters
+    int reported_count;
+} mount_cache_t;
 
-char colorbuf[COLOR_BUFFER_SIZE]; // For bar colors
+// Scan of --daemon on a worker thread. While it runs, the thread owns the
+// mount cache and the table it fills; the main loop keeps answering queries
+// from the previous table and is woken through done_fds when it is over.
+typedef struct
+{
+    mount_cache_t *mounts;
+    drive_table_t table;
+    int done_fds[2];     // Pipe the worker writes one byte to when finished
+    pthread_t thread;
+    bool running;        // The fields below belong to the main loop
+    bool requested;      // Scan again as soon as this one ends
+    bool mounts_changed; // Reparse the mount table on the next scan
+} daemon_scan_t;
+
+// Lines currently shown on the terminal in watch mode
+typedef struct
+{
+    char *text;   // Previous frame; lines point into it
+    char **lines;
+    int line_count;
+    int rows;     // Terminal height; lines below it are not drawn
+    bool interactive;
+} screen_t;
+
+// Layout of the text report, derived from the terminal width
+typedef struct
+{
+    int content_width;
+    int bar_length;
+} layout_t;
 
 // Function to compare drives by total capacity (descending order)
-int compare_drives_by_capacity(const void *a, const void *b)
+int compare_drives_by_capacity(const void *a, const void *b, void *context)
 {
-    const drive_info_t *drive_a = (const drive_info_t *)a;
-    const drive_info_t *drive_b = (const drive_info_t *)b;
+    const drive_table_t *table = (const drive_table_t *)context;
+    unsigned long long total_a = table->total_bytes[*(const uint32_t *)a];
+    unsigned long long total_b = table->total_bytes[*(const uint32_t *)b];
 
-    if (drive_b->total_bytes > drive_a->total_bytes)
+    if (total_b > total_a)
         return 1;
-    if (drive_b->total_bytes < drive_a->total_bytes)
+    if (total_b < total_a)
         return -1;
     return 0;
 }
 
 // Function to compare drives by usage (descending order)
-int compare_drives_by_usage(const void *a, const void *b)
+int compare_drives_by_usage(const void *a, const void *b, void *context)
 {
-    const drive_info_t *drive_a = (const drive_info_t *)a;
-    const drive_info_t *drive_b = (const drive_info_t *)b;
+    const drive_table_t *table = (const drive_table_t *)context;
+    double usage_a = table->usage_percent[*(const uint32_t *)a];
+    double usage_b = table->usage_percent[*(const uint32_t *)b];
 
-    if (drive_b->usage_percent > drive_a->usage_percent)
+    if (usage_b > usage_a)
         return 1;
-    if (drive_b->usage_percent < drive_a->usage_percent)
+    if (usage_b < usage_a)
         return -1;
     return 0;
 }
 
 // Function to compare drives by mount point (alphabetical)
-int compare_drives_by_mount(const void *a, const void *b)
+int compare_drives_by_mount(const void *a, const void *b, void *context)
 {
-    const drive_info_t *drive_a = (const drive_info_t *)a;
-    const drive_info_t *drive_b = (const drive_info_t *)b;
-    return strcmp(drive_a->mount_point, drive_b->mount_point);
+    const drive_table_t *table = (const drive_table_t *)context;
+    return strcmp(table->info[*(const uint32_t *)a].mount_point, table->info[*(const uint32_t *)b].mount_point);
 }
 
 // Function to compare drives by device name (alphabetical)
-int compare_drives_by_name(const void *a, const void *b)
+int compare_drives_by_name(const void *a, const void *b, void *context)
 {
-    const drive_info_t *drive_a = (const drive_info_t *)a;
-    const drive_info_t *drive_b = (const drive_info_t *)b;
-    return strcmp(drive_a->device, drive_b->device);
+    const drive_table_t *table = (const drive_table_t *)context;
+    return strcmp(table->info[*(const uint32_t *)a].device, table->info[*(const uint32_t *)b].device);
+}
+
+// Function to compare drives by the --sort keys in turn; ties keep the
+// table order, so the result does not depend on the sort algorithm
+int compare_drives(const void *a, const void *b, void *context)
+{
+    for (int k = 0; k < opt_sort_key_count; k++)
+    {
+        int result = 0;
+        switch (opt_sort_keys[k].field) {
+            case SORT_SIZE:
+                result = compare_drives_by_capacity(a, b, context);
+                break;
+            case SORT_USAGE:
+                result = compare_drives_by_usage(a, b, context);
+                break;
+            case SORT_MOUNT:
+                result = compare_drives_by_mount(a, b, context);
+                break;
+            case SORT_NAME:
+                result = compare_drives_by_name(a, b, context);
+                break;
+        }
+        if (result != 0)
+            return opt_sort_keys[k].reverse ? -result : result;
+    }
+    uint32_t index_a = *(const uint32_t *)a;
+    uint32_t index_b = *(const uint32_t *)b;
+    return index_a < index_b ? -1 : index_a > index_b;
 }
 
 // Function to display help text
 void show_help(const char *program_name)
 {
-    printf("Usage: %s [OPTIONS]\n", program_name);
+    printf("Usage: %s [OPTIONS] [PATH...]\n", program_name);
     printf("\n");
-    printf("Display information about available drives and their storage space.\n");
+    printf("Display information about available drives and their storage space, or\n");
+    printf("about the filesystem holding each PATH.\n");
     printf("\n");
     printf("Options:\n");
     printf("  -h, --help       Show this help message\n");
     printf("  -v, --version    Show program version\n");
     printf("  -j, --json       Output in JSON format\n");
+    printf("      --format FMT Output format: text (default), json (same as -j), the JSON\n");
+    printf("                   records as binary cbor or msgpack, or prometheus metrics\n");
+    printf("      --output FILE\n");
+    printf("                   Write each report to FILE, replaced atomically (e.g. a .prom\n");
+    printf("                   file in the node_exporter textfile directory)\n");
+    printf("      --daemon     Stay running, rescan every -w SECONDS (default %d) and on\n", DEFAULT_DAEMON_INTERVAL);
+    printf("                   mount changes, and publish the drives in a snapshot that\n");
+    printf("                   later drinfo runs read instead of scanning\n");
+    printf("      --snapshot FILE\n");
+    printf("                   Snapshot file of --daemon (default %s)\n", DEFAULT_SNAPSHOT_PATH);
+    printf("      --no-snapshot\n");
+    printf("                   Scan even if a daemon publishes a snapshot\n");
+    printf("      --socket PATH\n");
+    printf("                   Query socket of --daemon (default %s, \"\" = none)\n", DEFAULT_SOCKET_PATH);
+    printf("      --socket-mode MODE\n");
+    printf("                   Octal permissions of the query socket (default %04o)\n", DEFAULT_SOCKET_MODE);
+    printf("      --socket-group GROUP\n");
+    printf("                   Group of the query socket, allowed to query with the default mode\n");
     printf("  -n, --no-color   Disable color output\n");
-    printf("  -s, --sort TYPE  Sort drives by TYPE (size, usage, mount, name)\n");
+    printf("  -s, --sort KEYS  Sort drives by a comma separated list of size, usage, mount\n");
+    printf("                   and name; -KEY reverses one (e.g. usage,-size,mount)\n");
+    printf("      --top N      Only keep the first N drives after sorting\n");
+    printf("  -t, --timeout MS Give up on a mount that does not answer within MS\n");
+    printf("                   milliseconds (default %d, 0 = wait forever)\n", DEFAULT_PROBE_TIMEOUT_MS);
+    printf("  -d, --deadline MS\n");
+    printf("                   Stop probing after MS milliseconds in total (default: none)\n");
+    printf("  -w, --watch SECONDS\n");
+    printf("                   Keep running and refresh the report every SECONDS\n");
+    printf("      --ndjson     Print one JSON object per line for each drive as soon as\n");
+    printf("                   it is probed (unsorted)\n");
+    printf("  -e, --events     Print mount, unmount and remount events as JSON lines\n");
+    printf("                   whenever the mount table changes\n");
+    printf("      --root DIR   Inspect the system whose /proc, /sys, /dev and /run are\n");
+    printf("                   mounted below DIR, e.g. the host from a container\n");
+    printf("      --fields LIST\n");
+    printf("                   Only show (and only collect) the comma separated fields of\n");
+    printf("                   LIST: device, mount, fs, size, used, avail, use, type, uuid,\n");
+    printf("                   label, partuuid, diskid, diskpath, options, inodes, smart,\n");
+    printf("                   state, all (default all)\n");
+    printf("      --where EXPR Only report drives for which EXPR holds, e.g.\n");
+    printf("                   'type==nfs4 && usage>90 && mount=~^/data'. Mount table\n");
+    printf("                   fields are checked before probing, so others are not statted\n");
+    printf("      --exclude-type LIST\n");
+    printf("                   Skip mounts with one of the comma separated filesystem types\n");
+    printf("      --paths-from FILE\n");
+    printf("                   Also report the filesystems of the paths in FILE, one per\n");
+    printf("                   line (- reads standard input)\n");
+    printf("      --profile    Report wall time and syscalls of each phase and the 10\n");
+    printf("                   slowest mounts (on stderr, or as \"_meta\" with --json)\n");
+    printf("      --no-dedup   List every mount point of a filesystem as its own drive\n");
+    printf("                   (default: one entry per filesystem, probed once)\n");
+    printf("      --smart-ttl SECONDS\n");
+    printf("                   Reuse SMART data cached in %s for SECONDS\n", SMART_CACHE_DIR);
+    printf("                   (default %d, 0 = always query the drives)\n", DEFAULT_SMART_TTL);
+    printf("  -I, --identify FILE\n");
+    printf("                   Print type, UUID and label read from the superblock of a\n");
+    printf("                   device or filesystem image and exit\n");
+    printf("  -i, --isolate[=all]\n");
+    printf("                   Probe network/FUSE mounts (or all mounts) in killable helper\n");
+    printf("                   processes, so a mount stuck in D state cannot block the exit\n");
     printf("\n");
     printf("This program is licensed under the MIT License.\n");
     printf("https://github.com/lennart1978/drinfo\n");
@@ -199,6 +1074,17 @@ int get_terminal_width()
     return TERM_FALLBACK_WIDTH; // Fallback-Value
 }
 
+// Function to get terminal height
+int get_terminal_height()
+{
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_row > 0)
+    {
+        return w.ws_row;
+    }
+    return INT_MAX; // Not a terminal: nothing to clip
+}
+
 // Function to format bytes into human-readable sizes
 void format_bytes(unsigned long long bytes, char *buffer, size_t buffer_size)
 {
@@ -231,6 +1117,23 @@ double calculate_usage_percent(unsigned long long total, unsigned long long avai
     return ((double)used / total) * PERCENTAGE_MULTIPLIER;
 }
 
+// Helper: resolve an absolute system path (mount table, /dev, mount
+// points) below system_root. Returns path itself when there is no root.
+const char *rooted_path(const char *path, char *buffer, size_t size)
+{
+    if (!system_root[0])
+        return path;
+    snprintf(buffer, size, "%s%s", system_root, path);
+    return buffer;
+}
+
+// Helper: the mount table to read. Below a root, /proc/self would be our
+// own (container) namespace, so the table of the root's init is used.
+const char *mount_table_path(char *buffer, size_t size)
+{
+    return system_root[0] ? rooted_path(ROOT_MOUNT_TABLE_PATH, buffer, size) : MOUNT_TABLE_PATH;
+}
+
 bool is_physical_device(const char *fsname)
 {
     // Check for /dev/sd*, /dev/nvme*, /dev/hd*
@@ -269,178 +1172,678 @@ bool is_appimage_or_temp(const char *fsname, const char *mountpoint)
             strstr(mountpoint, "/tmp/") != NULL);
 }
 
-// Helper for true-color gradient (red-yellow-green)
-void get_bar_color(int idx, int max, char *buffer, size_t size)
+// Function to decide whether a mount should be probed in a helper process
+bool should_isolate(const char *device, const char *fstype)
 {
-    if (opt_no_color) {
-        buffer[0] = '\0';
-        return;
-    }
-
-    // New gradient: 0% = green (0,255,0), 50% = yellow (255,255,0), 100% = red (255,0,0)
-    float ratio = (float)idx / (float)(max - 1);
-    int r, g, b;
-    if (ratio < COLOR_RATIO_HALF)
-    {
-        // Green to Yellow
-        r = (int)(ratio * COLOR_RATIO_MULTIPLIER * MAX_COLOR_VALUE);
-        g = MAX_COLOR_VALUE;
-        b = 0;
-    }
-    else
-    {
-        // Yellow to Red
-        r = MAX_COLOR_VALUE;
-        g = (int)((1.0f - (ratio - COLOR_RATIO_HALF) * COLOR_RATIO_MULTIPLIER) * MAX_COLOR_VALUE);
-        b = 0;
-    }
-    snprintf(buffer, size, COLOR_FORMAT, r, g, b);
+    if (opt_isolate == ISOLATE_ALL)
+        return true;
+    return opt_isolate == ISOLATE_NETWORK &&
+           (is_network_filesystem(fstype) || is_network_device(device));
 }
 
-// Helper: visible length of a string without ANSI sequences
-int visible_length(const char *s)
+// Function to reserve room for extra bytes plus the terminating NUL
+bool strbuf_reserve(strbuf_t *sb, size_t extra)
 {
-    int len = 0;
-    int in_escape = 0;
-    for (; *s; ++s)
+    if (sb->failed)
+        return false;
+    if (sb->length + extra + 1 <= sb->capacity)
+        return true;
+    size_t capacity = sb->capacity ? sb->capacity : STRBUF_INITIAL_CAPACITY;
+    while (capacity < sb->length + extra + 1)
+        capacity *= 2;
+    char *grown = realloc(sb->data, capacity);
+    if (!grown)
     {
-        if (*s == '\033')
-            in_escape = 1;
-        else if (in_escape && *s == 'm')
-            in_escape = 0;
-        else if (!in_escape)
-            len++;
+        sb->failed = true;
+        return false;
     }
-    return len;
+    sb->data = grown;
+    sb->capacity = capacity;
+    return true;
 }
 
-// Function to check if a directory contains cloud storage
-bool is_cloud_storage_directory(const char *path)
+void strbuf_append(strbuf_t *sb, const char *s, size_t length)
 {
-    DIR *dir = opendir(path);
-    if (!dir)
-        return false;
+    if (!strbuf_reserve(sb, length))
+        return;
+    memcpy(sb->data + sb->length, s, length);
+    sb->length += length;
+    sb->data[sb->length] = '\0';
+}
 
-    struct dirent *entry;
-    bool has_cloud_storage = false;
+void strbuf_append_str(strbuf_t *sb, const char *s)
+{
+    strbuf_append(sb, s, strlen(s));
+}
 
-    while ((entry = readdir(dir)) != NULL)
-    {
-        // Use stat if d_type is not available
-        struct stat st;
-        char full_path[MAX_PATH_LENGTH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+void strbuf_printf(strbuf_t *sb, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0 || !strbuf_reserve(sb, (size_t)needed))
+        return;
+    va_start(args, format);
+    vsnprintf(sb->data + sb->length, (size_t)needed + 1, format, args);
+    va_end(args);
+    sb->length += (size_t)needed;
+}
 
-        if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode) &&
-            (strstr(entry->d_name, "google-drive") != NULL ||
-             strstr(entry->d_name, "dropbox") != NULL ||
-             strstr(entry->d_name, "onedrive") != NULL ||
-             strstr(entry->d_name, "mega") != NULL))
-        {
-            has_cloud_storage = true;
-            break;
-        }
-    }
+// Helper: empty the buffer but keep its memory for reuse
+void strbuf_reset(strbuf_t *sb)
+{
+    sb->length = 0;
+    if (sb->data)
+        sb->data[0] = '\0';
+}
 
-    closedir(dir);
-    return has_cloud_storage;
+void strbuf_free(strbuf_t *sb)
+{
+    free(sb->data);
+    memset(sb, 0, sizeof(*sb));
 }
 
-// Function to fill drive_info_t structure with common data
-void fill_drive_info(drive_info_t *drive,
-                     const char *mount_point,
-                     const char *filesystem,
-                     const char *device,
-                     const char *uuid,
-                     const char *label,
-                     const char *total_str,
-                     const char *used_str,
-                     const char *available_str,
-                     unsigned long long total_bytes,
-                     unsigned long long used_bytes,
-                     unsigned long long available_bytes,
-                     double usage_percent,
-                     const char *drive_type,
-                     char *progress_bar,
-                     bool is_cloud_storage,
-                     const char *cloud_service_name,
-                     const char *mount_options,
-                     unsigned long long total_inodes,
-                     unsigned long long used_inodes,
-                     double inode_usage)
-{
-    strncpy(drive->mount_point, mount_point, sizeof(drive->mount_point) - 1);
-    drive->mount_point[sizeof(drive->mount_point) - 1] = '\0';
-    strncpy(drive->filesystem, filesystem, sizeof(drive->filesystem) - 1);
-    drive->filesystem[sizeof(drive->filesystem) - 1] = '\0';
-    strncpy(drive->device, device, sizeof(drive->device) - 1);
-    drive->device[sizeof(drive->device) - 1] = '\0';
-    if (uuid)
-    {
-        strncpy(drive->uuid, uuid, sizeof(drive->uuid) - 1);
-        drive->uuid[sizeof(drive->uuid) - 1] = '\0';
-    }
-    else
+// Function to write all of data to fd, retrying short writes
+bool write_all(int fd, const char *data, size_t length)
+{
+    size_t written = 0;
+    while (written < length)
     {
-        drive->uuid[0] = '\0';
+        ssize_t n = write(fd, data + written, length - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        written += (size_t)n;
     }
-    if (label)
+    return true;
+}
+
+// Function to write a finished document to stdout with a single write().
+// Anything still buffered by stdio goes first so output stays in order.
+void strbuf_write_stdout(strbuf_t *sb)
+{
+    if (sb->failed)
     {
-        strncpy(drive->label, label, sizeof(drive->label) - 1);
-        drive->label[sizeof(drive->label) - 1] = '\0';
+        fprintf(stderr, "Error: out of memory while formatting output\n");
+        return;
     }
-    else
+    fflush(stdout);
+    write_all(STDOUT_FILENO, sb->data, sb->length);
+}
+
+// Function to replace path with data atomically: the data goes to a
+// temporary file next to it, which is renamed over path once complete, so
+// readers such as the node_exporter textfile collector never see half a file
+bool replace_file(const char *path, const char *data, size_t length)
+{
+    char temporary[MAX_PATH_LENGTH];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp.%ld", path, (long)getpid()) >= (int)sizeof(temporary))
     {
-        drive->label[0] = '\0';
+        fprintf(stderr, "%s: path too long\n", path);
+        return false;
+    }
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, OUTPUT_FILE_MODE);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: %s\n", temporary, strerror(errno));
+        return false;
+    }
+    bool ok = write_all(fd, data, length);
+    if (close(fd) != 0)
+        ok = false;
+    if (!ok || rename(temporary, path) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", ok ? path : temporary, strerror(errno));
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+// Function to deliver a finished report: to the --output file if one was
+// given, otherwise to stdout
+void write_output(strbuf_t *sb)
+{
+    if (!opt_output)
+    {
+        strbuf_write_stdout(sb);
+        return;
+    }
+    if (sb->failed)
+        fprintf(stderr, "Error: out of memory while formatting output\n");
+    if (sb->failed || !replace_file(opt_output, sb->data ? sb->data : "", sb->length))
+        output_failed = true;
+}
+
+// Helper: true if any byte of the 8-byte block needs escaping in a JSON
+// string, i.e. is a control character, '"' or '\\'. Each test is the usual
+// "has a zero byte" trick, which is exact as a yes/no answer.
+bool json_block_needs_escape(uint64_t block)
+{
+    uint64_t quote = block ^ (JSON_ONES * '"');
+    uint64_t backslash = block ^ (JSON_ONES * '\\');
+    uint64_t found = ((block - JSON_ONES * 0x20) & ~block) |
+                     ((quote - JSON_ONES) & ~quote) |
+                     ((backslash - JSON_ONES) & ~backslash);
+    return (found & JSON_HIGHS) != 0;
+}
+
+// Function to append s as a quoted JSON string. Clean runs are found eight
+// bytes at a time and copied in one go; only '"', '\\' and control
+// characters are escaped, other bytes are passed through unchanged.
+void json_append_string(strbuf_t *out, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t length = strlen(s);
+    size_t start = 0, i = 0;
+
+    strbuf_append(out, "\"", 1);
+    while (i < length)
+    {
+        uint64_t block;
+        if (length - i >= sizeof(block))
+        {
+            memcpy(&block, s + i, sizeof(block));
+            if (!json_block_needs_escape(block))
+            {
+                i += sizeof(block);
+                continue;
+            }
+        }
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            i++;
+            continue;
+        }
+
+        strbuf_append(out, s + start, i - start);
+        char escape[6] = {'\\', (char)c};
+        size_t escape_length = 2;
+        switch (c) {
+            case '"': case '\\': break;
+            case '\b': escape[1] = 'b'; break;
+            case '\f': escape[1] = 'f'; break;
+            case '\n': escape[1] = 'n'; break;
+            case '\r': escape[1] = 'r'; break;
+            case '\t': escape[1] = 't'; break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hex[c >> 4];
+                escape[5] = hex[c & 0xf];
+                escape_length = 6;
+                break;
+        }
+        strbuf_append(out, escape, escape_length);
+        start = ++i;
+    }
+    strbuf_append(out, s + start, length - start);
+    strbuf_append(out, "\"", 1);
+}
+
+// Function to append an unsigned integer in decimal, two digits per step
+void json_append_uint(strbuf_t *out, unsigned long long value)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[MAX_DECIMAL_LENGTH];
+    char *p = digits + sizeof(digits);
+
+    while (value >= 100)
+    {
+        unsigned pair = (unsigned)(value % 100) * 2;
+        value /= 100;
+        *--p = pairs[pair + 1];
+        *--p = pairs[pair];
     }
-    snprintf(drive->total_str, sizeof(drive->total_str), "%s", total_str);
-    snprintf(drive->used_str, sizeof(drive->used_str), "%s", used_str);
-    snprintf(drive->available_str, sizeof(drive->available_str), "%s", available_str);
-    drive->total_bytes = total_bytes;
-    drive->used_bytes = used_bytes;
-    drive->available_bytes = available_bytes;
-    drive->usage_percent = usage_percent;
-    drive->drive_type = drive_type;
-    drive->progress_bar = progress_bar;
-    drive->is_cloud_storage = is_cloud_storage;
-    if (cloud_service_name)
+    if (value >= 10)
     {
-        strncpy(drive->cloud_service_name, cloud_service_name, sizeof(drive->cloud_service_name) - 1);
-        drive->cloud_service_name[sizeof(drive->cloud_service_name) - 1] = '\0';
+        *--p = pairs[value * 2 + 1];
+        *--p = pairs[value * 2];
     }
     else
     {
-        drive->cloud_service_name[0] = '\0';
+        *--p = (char)('0' + value);
     }
-    if (mount_options)
+    strbuf_append(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+void json_append_int(strbuf_t *out, long long value)
+{
+    if (value < 0)
     {
-        strncpy(drive->mount_options, mount_options, sizeof(drive->mount_options) - 1);
-        drive->mount_options[sizeof(drive->mount_options) - 1] = '\0';
+        strbuf_append(out, "-", 1);
+        json_append_uint(out, 0ULL - (unsigned long long)value);
     }
     else
     {
-        drive->mount_options[0] = '\0';
+        json_append_uint(out, (unsigned long long)value);
     }
-    drive->total_inodes = total_inodes;
-    drive->used_inodes = used_inodes;
-    drive->inode_usage = inode_usage;
 }
 
-// Function to get cloud storage info from GVFS
-void get_cloud_storage_info(const char *gvfs_path, drive_info_t *drives, int *drive_count)
+// Function to append a number with a fixed count of decimals. Rounding
+// is left to snprintf() so the digits match what printf() always printed.
+void json_append_fixed(strbuf_t *out, double value, int decimals)
 {
-    DIR *dir = opendir(gvfs_path);
-    if (!dir)
+    char text[MAX_FLOAT_LENGTH];
+    int length = snprintf(text, sizeof(text), "%.*f", decimals, value);
+    if (length > 0)
+        strbuf_append(out, text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+}
+
+// Kinds of length-prefixed items of the binary formats
+typedef enum { BINARY_UINT, BINARY_STRING, BINARY_ARRAY, BINARY_MAP } binary_kind_t;
+
+// Encoding of the binary_append_*() helpers, FORMAT_CBOR or FORMAT_MSGPACK:
+// --format for reports, the requested one for socket queries
+output_format_t binary_format = FORMAT_CBOR;
+
+// Helper: append the low bytes of value, most significant first
+void binary_append_be(strbuf_t *out, uint64_t value, int bytes)
+{
+    unsigned char data[sizeof(uint64_t)];
+    for (int b = bytes - 1; b >= 0; b--, value >>= 8)
+        data[b] = (unsigned char)value;
+    strbuf_append(out, (const char *)data, (size_t)bytes);
+}
+
+// Helper: append a type byte followed by value in the smallest of 1, 2, 4
+// or 8 bytes. first is the type byte for 1 byte; the wider ones follow it.
+void binary_append_sized(strbuf_t *out, unsigned char first, uint64_t value)
+{
+    int step = value <= UINT8_MAX ? 0 : value <= UINT16_MAX ? 1 : value <= UINT32_MAX ? 2 : 3;
+    unsigned char type = (unsigned char)(first + step);
+    strbuf_append(out, (const char *)&type, 1);
+    binary_append_be(out, value, 1 << step);
+}
+
+// Function to append an unsigned integer, or the header of a string, array
+// or map of n items, in the binary_format encoding
+void binary_append_header(strbuf_t *out, binary_kind_t kind, uint64_t n)
+{
+    unsigned char byte;
+    if (binary_format == FORMAT_CBOR)
+    {
+        static const unsigned char majors[] = {CBOR_MAJOR_UINT, CBOR_MAJOR_TEXT, CBOR_MAJOR_ARRAY, CBOR_MAJOR_MAP};
+        if (n <= CBOR_INLINE_MAX)
+        {
+            byte = (unsigned char)(majors[kind] << 5 | n);
+            strbuf_append(out, (const char *)&byte, 1);
+        }
+        else
+        {
+            binary_append_sized(out, (unsigned char)(majors[kind] << 5 | CBOR_ARGUMENT_1), n);
+        }
+        return;
+    }
+
+    switch (kind) {
+        case BINARY_UINT:
+            if (n <= MSGPACK_FIXINT_MAX) {
+                byte = (unsigned char)n;
+                strbuf_append(out, (const char *)&byte, 1);
+            } else {
+                binary_append_sized(out, MSGPACK_UINT8, n);
+            }
+            return;
+        case BINARY_STRING:
+            if (n < 32) {
+                byte = (unsigned char)(MSGPACK_FIXSTR | n);
+                strbuf_append(out, (const char *)&byte, 1);
+            } else {
+                binary_append_sized(out, MSGPACK_STR8, n);
+            }
+            return;
+        case BINARY_ARRAY:
+        case BINARY_MAP:
+            if (n < 16) {
+                byte = (unsigned char)((kind == BINARY_ARRAY ? MSGPACK_FIXARRAY : MSGPACK_FIXMAP) | n);
+                strbuf_append(out, (const char *)&byte, 1);
+            } else {
+                // Only 16 and 32 bit lengths exist for arrays and maps
+                byte = (unsigned char)((kind == BINARY_ARRAY ? MSGPACK_ARRAY16 : MSGPACK_MAP16) + (n > UINT16_MAX));
+                strbuf_append(out, (const char *)&byte, 1);
+                binary_append_be(out, n, n > UINT16_MAX ? 4 : 2);
+            }
+            return;
+    }
+}
+
+void binary_append_int(strbuf_t *out, long long value)
+{
+    if (value >= 0)
+    {
+        binary_append_header(out, BINARY_UINT, (uint64_t)value);
+    }
+    else if (binary_format == FORMAT_CBOR)
+    {
+        // Major type 1 holds -1 - value
+        uint64_t argument = (uint64_t)(-(value + 1));
+        if (argument <= CBOR_INLINE_MAX)
+        {
+            unsigned char byte = (unsigned char)(CBOR_MAJOR_NEGATIVE << 5 | argument);
+            strbuf_append(out, (const char *)&byte, 1);
+        }
+        else
+        {
+            binary_append_sized(out, CBOR_MAJOR_NEGATIVE << 5 | CBOR_ARGUMENT_1, argument);
+        }
+    }
+    else if (value >= MSGPACK_NEGATIVE_FIXINT_MIN)
+    {
+        unsigned char byte = (unsigned char)(int8_t)value;
+        strbuf_append(out, (const char *)&byte, 1);
+    }
+    else
+    {
+        int step = value >= INT8_MIN ? 0 : value >= INT16_MIN ? 1 : value >= INT32_MIN ? 2 : 3;
+        unsigned char type = (unsigned char)(MSGPACK_INT8 + step);
+        strbuf_append(out, (const char *)&type, 1);
+        binary_append_be(out, (uint64_t)value, 1 << step);
+    }
+}
+
+void binary_append_string(strbuf_t *out, const char *s)
+{
+    size_t length = strlen(s);
+    binary_append_header(out, BINARY_STRING, length);
+    strbuf_append(out, s, length);
+}
+
+void binary_append_bool(strbuf_t *out, bool value)
+{
+    unsigned char byte = binary_format == FORMAT_CBOR ? (value ? CBOR_TRUE : CBOR_FALSE)
+                                                   : (value ? MSGPACK_TRUE : MSGPACK_FALSE);
+    strbuf_append(out, (const char *)&byte, 1);
+}
+
+void binary_append_null(strbuf_t *out)
+{
+    unsigned char byte = binary_format == FORMAT_CBOR ? CBOR_NULL : MSGPACK_NIL;
+    strbuf_append(out, (const char *)&byte, 1);
+}
+
+// Function to append a single precision float; percentages need no more
+void binary_append_float(strbuf_t *out, double value)
+{
+    float narrowed = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &narrowed, sizeof(bits));
+    unsigned char type = binary_format == FORMAT_CBOR ? CBOR_FLOAT32 : MSGPACK_FLOAT32;
+    strbuf_append(out, (const char *)&type, 1);
+    binary_append_be(out, bits, sizeof(bits));
+}
+
+// Function to carve size bytes (8-byte aligned) out of the arena
+void *arena_alloc(string_arena_t *arena, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    arena_block_t *block = arena->blocks;
+    if (!block || block->size - block->used < size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(arena_block_t) + block_size);
+        if (!block)
+            return NULL;
+        block->next = arena->blocks;
+        block->used = 0;
+        block->size = block_size;
+        arena->blocks = block;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+// Function to copy a string into the arena ("" if out of memory)
+const char *arena_strdup(string_arena_t *arena, const char *s)
+{
+    size_t length = strlen(s);
+    char *copy = arena_alloc(arena, length + 1);
+    if (!copy)
+        return "";
+    memcpy(copy, s, length + 1);
+    return copy;
+}
+
+// Helper: FNV-1a hash of a string
+size_t hash_string(const char *s)
+{
+    size_t hash = 14695981039346656037ULL;
+    for (; *s; s++)
+        hash = (hash ^ (unsigned char)*s) * 1099511628211ULL;
+    return hash;
+}
+
+// Function to return the arena's single copy of a string, adding it on first use
+const char *arena_intern(string_arena_t *arena, const char *s)
+{
+    if ((arena->interned_count + 1) * 10 > arena->interned_capacity * 7)
+    {
+        size_t capacity = arena->interned_capacity ? arena->interned_capacity * 2 : INTERN_INITIAL_CAPACITY;
+        const char **slots = calloc(capacity, sizeof(char *));
+        if (!slots)
+            return arena_strdup(arena, s);
+        for (size_t i = 0; i < arena->interned_capacity; i++)
+        {
+            const char *old = arena->interned[i];
+            if (!old)
+                continue;
+            size_t slot = hash_string(old) & (capacity - 1);
+            while (slots[slot])
+                slot = (slot + 1) & (capacity - 1);
+            slots[slot] = old;
+        }
+        free(arena->interned);
+        arena->interned = slots;
+        arena->interned_capacity = capacity;
+    }
+
+    size_t slot = hash_string(s) & (arena->interned_capacity - 1);
+    while (arena->interned[slot])
+    {
+        if (strcmp(arena->interned[slot], s) == 0)
+            return arena->interned[slot];
+        slot = (slot + 1) & (arena->interned_capacity - 1);
+    }
+    const char *copy = arena_strdup(arena, s);
+    if (*copy)
+    {
+        arena->interned[slot] = copy;
+        arena->interned_count++;
+    }
+    return copy;
+}
+
+// Function to drop all strings, keeping the newest block for reuse
+void arena_reset(string_arena_t *arena)
+{
+    if (arena->blocks)
+    {
+        arena_block_t *block = arena->blocks->next;
+        while (block)
+        {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+        arena->blocks->next = NULL;
+        arena->blocks->used = 0;
+    }
+    if (arena->interned)
+        memset(arena->interned, 0, arena->interned_capacity * sizeof(char *));
+    arena->interned_count = 0;
+}
+
+void arena_free(string_arena_t *arena)
+{
+    arena_reset(arena);
+    free(arena->blocks);
+    free(arena->interned);
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Helper for true-color gradient (red-yellow-green)
+void get_gradient_rgb(int idx, int max, int *r, int *g, int *b)
+{
+    // New gradient: 0% = green (0,255,0), 50% = yellow (255,255,0), 100% = red (255,0,0)
+    float ratio = (float)idx / (float)(max - 1);
+    if (ratio < COLOR_RATIO_HALF)
+    {
+        // Green to Yellow
+        *r = (int)(ratio * COLOR_RATIO_MULTIPLIER * MAX_COLOR_VALUE);
+        *g = MAX_COLOR_VALUE;
+        *b = 0;
+    }
+    else
+    {
+        // Yellow to Red
+        *r = MAX_COLOR_VALUE;
+        *g = (int)((1.0f - (ratio - COLOR_RATIO_HALF) * COLOR_RATIO_MULTIPLIER) * MAX_COLOR_VALUE);
+        *b = 0;
+    }
+}
+
+// Function to precompute the escape sequences of every bar cell
+void build_bar_palette(bar_palette_t *palette, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        int r, g, b;
+        get_gradient_rgb(i, length, &r, &g, &b);
+        palette->fg_length[i] = (unsigned char)snprintf(palette->fg[i], COLOR_BUFFER_SIZE, COLOR_FORMAT, r, g, b);
+        palette->bg_length[i] = (unsigned char)snprintf(palette->bg[i], COLOR_BUFFER_SIZE, BACKGROUND_COLOR_FORMAT, r, g, b);
+    }
+    palette->text_length = (unsigned char)snprintf(palette->text, sizeof(palette->text), BLUE_TEXT_FORMAT,
+                                                   BLUE_TEXT_R, BLUE_TEXT_G, BLUE_TEXT_B);
+    palette->empty_length = (unsigned char)snprintf(palette->empty, sizeof(palette->empty),
+                                                    BACKGROUND_COLOR_FORMAT COLOR_FORMAT,
+                                                    GRAY_BACKGROUND_R, GRAY_BACKGROUND_G, GRAY_BACKGROUND_B,
+                                                    GRAY_FOREGROUND_R, GRAY_FOREGROUND_G, GRAY_FOREGROUND_B);
+    palette->length = length;
+}
+
+// Function to render a usage bar with the percentage centered on its filled
+// part. Appends to out, so a reused buffer makes this allocation-free.
+void render_progress_bar(strbuf_t *out, double usage_percent, int bar_length)
+{
+    if (bar_length > MAX_BAR_LENGTH)
+        bar_length = MAX_BAR_LENGTH;
+    int filled_length = (int)((usage_percent / USAGE_PERCENT_DIVISOR) * bar_length);
+    char percent_text[MAX_PERCENT_TEXT_LENGTH];
+    snprintf(percent_text, sizeof(percent_text), PERCENT_FORMAT, usage_percent);
+    int text_length = strlen(percent_text);
+    int text_start = filled_length > text_length ? (filled_length - text_length) / 2 : 0;
+
+    // Worst case per cell: background + text color + one character
+    if (!strbuf_reserve(out, (size_t)bar_length * 2 * COLOR_BUFFER_SIZE + 2 * COLOR_BUFFER_SIZE))
+        return;
+
+    if (opt_no_color)
+    {
+        for (int i = 0; i < bar_length; i++)
+        {
+            if (i >= text_start && i < text_start + text_length && i < filled_length)
+                strbuf_append(out, &percent_text[i - text_start], 1);
+            else if (i < filled_length)
+                strbuf_append(out, BAR_FILLED_CHAR, sizeof(BAR_FILLED_CHAR) - 1);
+            else
+                strbuf_append(out, BAR_EMPTY_CHAR, sizeof(BAR_EMPTY_CHAR) - 1);
+        }
         return;
+    }
+
+    bar_palette_t *palette = &bar_palette;
+    if (palette->length != bar_length)
+        build_bar_palette(palette, bar_length);
+
+    // Colors are only emitted when they change between cells
+    enum { CELL_NONE, CELL_TEXT, CELL_FILLED, CELL_EMPTY } previous = CELL_NONE;
+    for (int i = 0; i < bar_length; i++)
+    {
+        if (i >= text_start && i < text_start + text_length && i < filled_length)
+        {
+            strbuf_append(out, palette->bg[i], palette->bg_length[i]);
+            if (previous != CELL_TEXT)
+                strbuf_append(out, palette->text, palette->text_length);
+            strbuf_append(out, &percent_text[i - text_start], 1);
+            previous = CELL_TEXT;
+        }
+        else if (i < filled_length)
+        {
+            if (previous == CELL_TEXT)
+                strbuf_append(out, RESET_FORMAT, sizeof(RESET_FORMAT) - 1);
+            strbuf_append(out, palette->fg[i], palette->fg_length[i]);
+            strbuf_append(out, BAR_FILLED_CHAR, sizeof(BAR_FILLED_CHAR) - 1);
+            previous = CELL_FILLED;
+        }
+        else
+        {
+            if (previous != CELL_EMPTY)
+                strbuf_append(out, palette->empty, palette->empty_length);
+            strbuf_append(out, BAR_EMPTY_CHAR, sizeof(BAR_EMPTY_CHAR) - 1);
+            previous = CELL_EMPTY;
+        }
+    }
+    if (previous != CELL_NONE)
+        strbuf_append(out, RESET_FORMAT, sizeof(RESET_FORMAT) - 1);
+}
+
+// Helper: visible length of a string without ANSI sequences. UTF-8
+// continuation bytes do not count, so "█" is one column.
+int visible_length(const char *s)
+{
+    int len = 0;
+    int in_escape = 0;
+    for (; *s; ++s)
+    {
+        if (*s == '\033')
+            in_escape = 1;
+        else if (in_escape && *s == 'm')
+            in_escape = 0;
+        else if (!in_escape && ((unsigned char)*s & 0xC0) != 0x80)
+            len++;
+    }
+    return len;
+}
+
+// Function to compute the report layout for a terminal width
+layout_t compute_layout(int terminal_width)
+{
+    // Target width: 80% of terminal width or max. 120 characters
+    layout_t layout;
+    int box_width = terminal_width * TERMINAL_WIDTH_PERCENTAGE / TERMINAL_WIDTH_DIVISOR;
+    if (box_width > MAX_BOX_WIDTH)
+        box_width = MAX_BOX_WIDTH;
+    if (box_width < MIN_BOX_WIDTH)
+        box_width = MIN_BOX_WIDTH;
+    layout.content_width = box_width - FRAME_PADDING;          // for frame
+    layout.bar_length = layout.content_width - BRACKET_PADDING; // for [ and ]
+    if (layout.bar_length < MIN_BAR_LENGTH)
+        layout.bar_length = MIN_BAR_LENGTH;
+    return layout;
+}
+
+// Function to check if a directory contains cloud storage
+bool is_cloud_storage_directory(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+        return false;
 
     struct dirent *entry;
+    bool has_cloud_storage = false;
 
-    while ((entry = readdir(dir)) != NULL && *drive_count < MAX_DRIVES)
+    while ((entry = readdir(dir)) != NULL)
     {
         // Use stat if d_type is not available
         struct stat st;
         char full_path[MAX_PATH_LENGTH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", gvfs_path, entry->d_name);
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
 
         if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode) &&
             (strstr(entry->d_name, "google-drive") != NULL ||
@@ -448,457 +1851,5453 @@ void get_cloud_storage_info(const char *gvfs_path, drive_info_t *drives, int *dr
              strstr(entry->d_name, "onedrive") != NULL ||
              strstr(entry->d_name, "mega") != NULL))
         {
-
-            // Get file system information
-            struct statvfs fs_info;
-            if (statvfs(full_path, &fs_info) != 0)
-            {
-                continue;
-            }
-
-            // Calculate sizes
-            unsigned long long total_bytes = (unsigned long long)fs_info.f_blocks * fs_info.f_frsize;
-            unsigned long long available_bytes = (unsigned long long)fs_info.f_bavail * fs_info.f_frsize;
-            unsigned long long used_bytes = total_bytes - available_bytes;
-
-            // Format sizes for output
-            char total_str[MAX_SIZE_STR_LENGTH], used_str[MAX_SIZE_STR_LENGTH], available_str[MAX_SIZE_STR_LENGTH];
-            format_bytes(total_bytes, total_str, sizeof(total_str));
-            format_bytes(used_bytes, used_str, sizeof(used_str));
-            format_bytes(available_bytes, available_str, sizeof(available_str));
-
-            // Target width calculation (same as before)
-            int terminal_width = get_terminal_width();
-            int box_width = terminal_width * TERMINAL_WIDTH_PERCENTAGE / TERMINAL_WIDTH_DIVISOR;
-            if (box_width > MAX_BOX_WIDTH)
-                box_width = MAX_BOX_WIDTH;
-            if (box_width < MIN_BOX_WIDTH)
-                box_width = MIN_BOX_WIDTH;
-            int content_width = box_width - FRAME_PADDING;
-            int bar_length = content_width - BRACKET_PADDING;
-            if (bar_length < MIN_BAR_LENGTH)
-                bar_length = MIN_BAR_LENGTH;
-
-            // Calculate usage
-            double usage_percent = calculate_usage_percent(total_bytes, available_bytes);
-            int filled_length = (int)((usage_percent / USAGE_PERCENT_DIVISOR) * bar_length);
-            char percent_text[MAX_PERCENT_TEXT_LENGTH];
-            snprintf(percent_text, sizeof(percent_text), PERCENT_FORMAT, usage_percent);
-            int text_length = strlen(percent_text);
-            int text_start = filled_length > text_length ? (filled_length - text_length) / 2 : 0;
-
-            // Create progress bar
-            size_t bar_bufsize = bar_length * MAX_BAR_BUFFER_MULTIPLIER + 1;
-            char *bar = malloc(bar_bufsize);
-            if (!bar)
-            {
-                perror("malloc");
-                continue;
-            }
-            bar[0] = '\0';
-            for (int i = 0; i < bar_length; i++)
-            {
-                if (i >= text_start && i < text_start + text_length && i < filled_length)
-                {
-                    if (!opt_no_color) {
-                        get_bar_color(i, bar_length, colorbuf, sizeof(colorbuf));
-                        int r, g, b;
-                        sscanf(colorbuf, COLOR_FORMAT, &r, &g, &b);
-                        char tmp[MAX_TEMP_BUFFER_LENGTH];
-                        snprintf(tmp, sizeof(tmp), BACKGROUND_COLOR_FORMAT BLUE_TEXT_FORMAT "%c" RESET_FORMAT, r, g, b, BLUE_TEXT_R, BLUE_TEXT_G, BLUE_TEXT_B, percent_text[i - text_start]);
-                        strncat(bar, tmp, bar_bufsize - strlen(bar) - 1);
-                    } else {
-                        char tmp[2] = {percent_text[i - text_start], '\0'};
-                        strncat(bar, tmp, bar_bufsize - strlen(bar) - 1);
-                    }
-                }
-                else if (i < filled_length)
-                {
-                    if (!opt_no_color) {
-                        get_bar_color(i, bar_length, colorbuf, sizeof(colorbuf));
-                        strncat(bar, colorbuf, bar_bufsize - strlen(bar) - 1);
-                        strncat(bar, "█" RESET_FORMAT, bar_bufsize - strlen(bar) - 1);
-                    } else {
-                        strncat(bar, "█", bar_bufsize - strlen(bar) - 1);
-                    }
-                }
-                else
-                {
-                    if (!opt_no_color) {
-                        strncat(bar, "\033[48;2;64;64;64m\033[38;2;160;160;160m░\033[0m", bar_bufsize - strlen(bar) - 1);
-                    } else {
-                        strncat(bar, "░", bar_bufsize - strlen(bar) - 1);
-                    }
-                }
-            }
-
-            // Determine cloud service name
-            const char *service_name = "Cloud Storage";
-            if (strstr(entry->d_name, "google-drive") != NULL)
-            {
-                service_name = "Google Drive";
-            }
-            else if (strstr(entry->d_name, "dropbox") != NULL)
-            {
-                service_name = "Dropbox";
-            }
-            else if (strstr(entry->d_name, "onedrive") != NULL)
-            {
-                service_name = "OneDrive";
-            }
-            else if (strstr(entry->d_name, "mega") != NULL)
-            {
-                service_name = "MEGA";
-            }
-
-            // Store information in drive_info_t structure
-            drive_info_t *drive = &drives[*drive_count];
-            fill_drive_info(drive, full_path, "fuse.gvfsd-fuse", entry->d_name,
-                            NULL, NULL,
-                            total_str, used_str, available_str,
-                            total_bytes, used_bytes, available_bytes,
-                            usage_percent, "Network Drive", bar, true, service_name, NULL,
-                            (unsigned long long)fs_info.f_blocks, (unsigned long long)fs_info.f_files,
-                            (double)fs_info.f_files / (double)fs_info.f_blocks);
-
-            (*drive_count)++;
+            has_cloud_storage = true;
+            break;
         }
     }
 
     closedir(dir);
+    return has_cloud_storage;
 }
 
-void get_uuid_and_label(const char *device, char *uuid, size_t uuid_size, char *label, size_t label_size)
+// Function to determine the cloud service name from a GVFS entry
+const char *get_cloud_service_name(const char *name)
 {
-    uuid[0] = '\0';
-    label[0] = '\0';
+    if (strstr(name, "google-drive") != NULL)
+        return "Google Drive";
+    if (strstr(name, "dropbox") != NULL)
+        return "Dropbox";
+    if (strstr(name, "onedrive") != NULL)
+        return "OneDrive";
+    if (strstr(name, "mega") != NULL)
+        return "MEGA";
+    return NULL;
+}
 
-    char resolved_device[PATH_MAX];
-    if (!realpath(device, resolved_device))
+// Function to append a probe job, growing the array as needed
+probe_job_t *add_probe_job(probe_job_t **jobs, int *count, int *capacity)
+{
+    if (*count == *capacity)
     {
-        // Wenn das Gerät nicht auflösbar ist, abbrechen
-        return;
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        probe_job_t *grown = realloc(*jobs, (size_t)new_capacity * sizeof(probe_job_t));
+        if (!grown)
+        {
+            perror("realloc");
+            return NULL;
+        }
+        *jobs = grown;
+        *capacity = new_capacity;
     }
+    probe_job_t *job = &(*jobs)[(*count)++];
+    memset(job, 0, sizeof(*job));
+    job->state = PROBE_PENDING;
+    return job;
+}
+
+// Function to collect cloud storage mounts from GVFS as probe jobs
+void collect_cloud_storage_jobs(const char *gvfs_path, probe_job_t **jobs, int *count, int *capacity)
+{
+    char rooted[MAX_ROOTED_PATH_LENGTH];
+    DIR *dir = opendir(rooted_path(gvfs_path, rooted, sizeof(rooted)));
+    if (!dir)
+        return;
+
+    struct dirent *entry;
 
-    // UUID suchen
-    DIR *uuid_dir = opendir("/dev/disk/by-uuid/");
-    if (uuid_dir)
+    while ((entry = readdir(dir)) != NULL)
     {
-        struct dirent *entry;
-        char full_path[PATH_MAX];
-        char resolved_link[PATH_MAX];
-        while ((entry = readdir(uuid_dir)) != NULL)
-        {
-            if (entry->d_name[0] == '.')
-                continue;
-            snprintf(full_path, sizeof(full_path), "/dev/disk/by-uuid/%s", entry->d_name);
-            if (realpath(full_path, resolved_link))
-            {
-                if (strcmp(resolved_link, resolved_device) == 0)
+        const char *service_name = get_cloud_service_name(entry->d_name);
+        if (!service_name)
+            continue;
+
+        // Use stat if d_type is not available
+        struct stat st;
+        char full_path[MAX_PATH_LENGTH];
+        snprintf(full_path, sizeof(full_path), "%s/%s", gvfs_path, entry->d_name);
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode))
+            continue;
+
+        probe_job_t *job = add_probe_job(jobs, count, capacity);
+        if (!job)
+            break;
+        snprintf(job->mount_point, sizeof(job->mount_point), "%s", full_path);
+        snprintf(job->device, sizeof(job->device), "%s", entry->d_name);
+        snprintf(job->filesystem, sizeof(job->filesystem), "%s", "fuse.gvfsd-fuse");
+        job->cloud_service_name = service_name;
+        job->isolated = should_isolate(job->device, job->filesystem);
+    }
+
+    closedir(dir);
+}
+
+// Helper: milliseconds from a to b on the monotonic clock
+long long timespec_diff_ms(const struct timespec *a, const struct timespec *b)
+{
+    return (long long)(b->tv_sec - a->tv_sec) * MS_PER_SECOND + (b->tv_nsec - a->tv_nsec) / NS_PER_MS;
+}
+
+// Helper: microseconds from a to b on the monotonic clock
+long long timespec_diff_us(const struct timespec *a, const struct timespec *b)
+{
+    return (long long)(b->tv_sec - a->tv_sec) * US_PER_SECOND + (b->tv_nsec - a->tv_nsec) / NS_PER_US;
+}
+
+// Helper: advance a timespec by a number of milliseconds
+void timespec_add_ms(struct timespec *ts, long long ms)
+{
+    ts->tv_sec += ms / MS_PER_SECOND;
+    ts->tv_nsec += (ms % MS_PER_SECOND) * NS_PER_MS;
+    if (ts->tv_nsec >= NS_PER_SECOND)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= NS_PER_SECOND;
+    }
+}
+
+// Helper: read the syscall counter of --profile, 0 if there is none
+long long profile_syscalls()
+{
+    long long count = 0;
+    if (profile.syscall_fd < 0 || read(profile.syscall_fd, &count, sizeof(count)) != (ssize_t)sizeof(count))
+        return 0;
+    return count;
+}
+
+// Function to start counting the syscalls of this process and of every
+// thread and child it starts from now on
+void profile_start()
+{
+    FILE *fp = fopen(SYSCALL_TRACEPOINT_ID, "r");
+    if (!fp)
+        fp = fopen(SYSCALL_TRACEPOINT_ID_DEBUGFS, "r");
+    unsigned long long id = 0;
+    bool has_id = fp && fscanf(fp, "%llu", &id) == 1;
+    if (fp)
+        fclose(fp);
+    if (!has_id)
+        return;
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    attr.inherit = 1;
+    profile.syscall_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+// Function to mark the start of a measured stretch (free without --profile)
+profile_mark_t profile_begin()
+{
+    profile_mark_t mark = {0, 0};
+    if (!opt_profile)
+        return mark;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    mark.ns = (long long)now.tv_sec * NS_PER_SECOND + now.tv_nsec;
+    mark.syscalls = profile_syscalls();
+    return mark;
+}
+
+// Function to add the stretch since mark to a phase. Phases can be entered
+// many times (one UUID lookup per drive); the totals add up.
+void profile_end(profile_phase_t phase, profile_mark_t mark)
+{
+    if (!opt_profile)
+        return;
+    profile_mark_t now = profile_begin();
+    profile.phase_ns[phase] += now.ns - mark.ns;
+    // Leave out the read() of the counter itself
+    if (profile.syscall_fd >= 0)
+        profile.phase_syscalls[phase] += now.syscalls - mark.syscalls - 1;
+}
+
+// Function to count a finished probe in the latency histogram
+void record_probe_latency(const probe_job_t *job)
+{
+    if (opt_format != FORMAT_PROMETHEUS || (job->state != PROBE_DONE && job->state != PROBE_TIMEOUT))
+        return;
+    int b = 0;
+    while (b < PROBE_LATENCY_BUCKET_COUNT && job->elapsed_us > probe_latency_bounds_us[b])
+        b++;
+    if (b < PROBE_LATENCY_BUCKET_COUNT)
+        probe_latency.buckets[b]++;
+    probe_latency.count++;
+    probe_latency.sum_us += job->elapsed_us;
+}
+
+// Function to remember a probed mount if it is among the slowest so far
+void profile_add_mount(const probe_job_t *job)
+{
+    if (!opt_profile)
+        return;
+    profile.mount_count++;
+    int slot = profile.slowest_count;
+    while (slot > 0 && profile.slowest[slot - 1].elapsed_us < job->elapsed_us)
+        slot--;
+    if (slot >= PROFILE_SLOWEST_MOUNTS)
+        return;
+    int last = profile.slowest_count < PROFILE_SLOWEST_MOUNTS ? profile.slowest_count : PROFILE_SLOWEST_MOUNTS - 1;
+    memmove(&profile.slowest[slot + 1], &profile.slowest[slot], (size_t)(last - slot) * sizeof(profile_mount_t));
+    profile_mount_t *entry = &profile.slowest[slot];
+    snprintf(entry->mount_point, sizeof(entry->mount_point), "%s", job->mount_point);
+    entry->elapsed_us = job->elapsed_us;
+    entry->state = job->state;
+    if (profile.slowest_count < PROFILE_SLOWEST_MOUNTS)
+        profile.slowest_count++;
+}
+
+// Helper: how a probe ended, as shown by --profile
+const char *probe_state_name(probe_state_t state)
+{
+    return state == PROBE_TIMEOUT ? "timeout" : state == PROBE_FAILED ? "failed" : "ok";
+}
+
+// Function to print the --profile report as text
+void print_profile(FILE *out)
+{
+    bool counted = profile.syscall_fd >= 0;
+    long long total_ns = 0, total_syscalls = 0;
+    fprintf(out, "\nProfile:\n");
+    fprintf(out, "  %-12s %12s %10s\n", "Phase", "Time (ms)", "Syscalls");
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        total_ns += profile.phase_ns[p];
+        total_syscalls += profile.phase_syscalls[p];
+        if (counted)
+            fprintf(out, "  %-12s %12.3f %10lld\n", profile_phase_names[p], (double)profile.phase_ns[p] / NS_PER_MS,
+                    profile.phase_syscalls[p]);
+        else
+            fprintf(out, "  %-12s %12.3f %10s\n", profile_phase_names[p], (double)profile.phase_ns[p] / NS_PER_MS, "-");
+    }
+    if (counted)
+        fprintf(out, "  %-12s %12.3f %10lld\n", "total", (double)total_ns / NS_PER_MS, total_syscalls);
+    else
+        fprintf(out, "  %-12s %12.3f %10s\n", "total", (double)total_ns / NS_PER_MS, "-");
+    if (!counted)
+        fprintf(out, "  (syscalls are counted as root with tracefs mounted)\n");
+
+    fprintf(out, "\nSlowest of %d probed mounts:\n", profile.mount_count);
+    for (int i = 0; i < profile.slowest_count; i++)
+    {
+        const profile_mount_t *entry = &profile.slowest[i];
+        fprintf(out, "  %12.3f ms  %s", (double)entry->elapsed_us / MS_PER_SECOND, entry->mount_point);
+        if (entry->state != PROBE_DONE)
+            fprintf(out, " (%s)", probe_state_name(entry->state));
+        fprintf(out, "\n");
+    }
+}
+
+// Function to append the --profile report as the "_meta" member of the
+// JSON output
+void render_json_profile(strbuf_t *out) {
+    bool counted = profile.syscall_fd >= 0;
+    long long total_ns = 0, total_syscalls = 0;
+    strbuf_append_str(out, "  \"_meta\": {\n    \"phases\": {\n");
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++) {
+        total_ns += profile.phase_ns[p];
+        total_syscalls += profile.phase_syscalls[p];
+        strbuf_append_str(out, "      ");
+        json_append_string(out, profile_phase_names[p]);
+        strbuf_append_str(out, ": {\"ms\": ");
+        json_append_fixed(out, (double)profile.phase_ns[p] / NS_PER_MS, 3);
+        strbuf_append_str(out, ", \"syscalls\": ");
+        if (counted) json_append_int(out, profile.phase_syscalls[p]);
+        else strbuf_append_str(out, "null");
+        strbuf_append_str(out, p < PROFILE_PHASE_COUNT - 1 ? "},\n" : "}\n");
+    }
+    strbuf_append_str(out, "    },\n    \"total_ms\": ");
+    json_append_fixed(out, (double)total_ns / NS_PER_MS, 3);
+    strbuf_append_str(out, ",\n    \"total_syscalls\": ");
+    if (counted) json_append_int(out, total_syscalls);
+    else strbuf_append_str(out, "null");
+    strbuf_append_str(out, ",\n    \"probed_mounts\": ");
+    json_append_int(out, profile.mount_count);
+    strbuf_append_str(out, ",\n    \"slowest_mounts\": [");
+    for (int i = 0; i < profile.slowest_count; i++) {
+        const profile_mount_t *entry = &profile.slowest[i];
+        strbuf_append_str(out, i ? ",\n      {\"mount_point\": " : "\n      {\"mount_point\": ");
+        json_append_string(out, entry->mount_point);
+        strbuf_append_str(out, ", \"ms\": ");
+        json_append_fixed(out, (double)entry->elapsed_us / MS_PER_SECOND, 3);
+        strbuf_append_str(out, ", \"state\": ");
+        json_append_string(out, probe_state_name(entry->state));
+        strbuf_append_str(out, "}");
+    }
+    strbuf_append_str(out, profile.slowest_count ? "\n    ]\n  }\n" : "]\n  }\n");
+}
+
+// Helper: drop one reference to the probe pool, freeing it on the last one
+void probe_pool_release(probe_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    bool last = --pool->refs == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (last)
+    {
+        pthread_cond_destroy(&pool->changed);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->jobs);
+        free(pool);
+    }
+}
+
+// Helper: reap killed helpers that have finally exited
+void reap_abandoned_helpers()
+{
+    pthread_mutex_lock(&abandoned_helpers_lock);
+    for (int i = 0; i < abandoned_helper_count;)
+    {
+        if (waitpid(abandoned_helpers[i], NULL, WNOHANG) != 0)
+            abandoned_helpers[i] = abandoned_helpers[--abandoned_helper_count];
+        else
+            i++;
+    }
+    pthread_mutex_unlock(&abandoned_helpers_lock);
+}
+
+// Helper: close descriptors first to last (inclusive) with close_range().
+// Returns false if the kernel does not have it.
+bool close_fd_range(int first, int last)
+{
+    if (first > last)
+        return true;
+    return syscall(SYS_close_range, (unsigned int)first, (unsigned int)last, 0) == 0;
+}
+
+// Function to close every descriptor above stderr but keep_a and keep_b: in
+// at most three close_range() calls, else for the ones /proc/self/fd lists,
+// and only if that is missing too for every possible number. Safe after
+// fork(): the directory is read with getdents64() into a stack buffer.
+void close_other_fds(int keep_a, int keep_b)
+{
+    int low = keep_a < keep_b ? keep_a : keep_b;
+    int high = keep_a < keep_b ? keep_b : keep_a;
+    if (close_fd_range(STDERR_FILENO + 1, low - 1) && close_fd_range(low + 1, high - 1) &&
+        close_fd_range(high + 1, INT_MAX))
+        return;
+
+    int dir_fd = open(SELF_FD_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+    {
+        char buffer[SELF_FD_READ_SIZE] __attribute__((aligned(8)));
+        long length;
+        while ((length = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (long offset = 0; offset < length;)
+            {
+                const struct dirent64 *entry = (const struct dirent64 *)(buffer + offset);
+                offset += entry->d_reclen;
+                int fd = 0;
+                const char *digit = entry->d_name;
+                while (*digit >= '0' && *digit <= '9')
+                    fd = fd * 10 + (*digit++ - '0');
+                if (*digit == '\0' && digit != entry->d_name && fd > STDERR_FILENO && fd != keep_a &&
+                    fd != keep_b && fd != dir_fd)
+                    close(fd);
+            }
+        }
+        close(dir_fd);
+        return;
+    }
+    for (int fd = STDERR_FILENO + 1; fd < HELPER_MAX_FD; fd++)
+    {
+        if (fd != keep_a && fd != keep_b)
+            close(fd);
+    }
+}
+
+// Helper process main loop. Runs after fork() in a multithreaded parent, so it
+// sticks to async-signal-safe calls and never returns.
+void probe_helper_main(int request_fd, int response_fd)
+{
+    // Keep nothing of the parent: a helper stuck in D state must not hold
+    // the caller's stdout open or the pipes of other helpers.
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    close_other_fds(request_fd, response_fd);
+
+    helper_request_t request;
+    while (read(request_fd, &request, sizeof(request)) == (ssize_t)sizeof(request))
+    {
+        helper_response_t response;
+        memset(&response, 0, sizeof(response));
+        request.path[sizeof(request.path) - 1] = '\0';
+        response.rc = statvfs(request.path, &response.fs_info);
+        if (write(response_fd, &response, sizeof(response)) != (ssize_t)sizeof(response))
+            break;
+    }
+    _exit(0);
+}
+
+// Function to fork a helper process with its request and response pipes
+bool probe_helper_start(probe_helper_t *helper)
+{
+    int request_pipe[2], response_pipe[2];
+    if (pipe2(request_pipe, O_CLOEXEC) != 0)
+        return false;
+    if (pipe2(response_pipe, O_CLOEXEC) != 0)
+    {
+        close(request_pipe[0]);
+        close(request_pipe[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+        probe_helper_main(request_pipe[0], response_pipe[1]);
+
+    close(request_pipe[0]);
+    close(response_pipe[1]);
+    if (pid < 0)
+    {
+        close(request_pipe[1]);
+        close(response_pipe[0]);
+        return false;
+    }
+    helper->pid = pid;
+    helper->request_fd = request_pipe[1];
+    helper->response_fd = response_pipe[0];
+    return true;
+}
+
+// Function to stop a helper. An idle helper exits on EOF; a hung one is
+// killed and, if it cannot be reaped right away, remembered for later.
+void probe_helper_stop(probe_helper_t *helper, bool kill_it)
+{
+    if (helper->pid <= 0)
+        return;
+    close(helper->request_fd);
+    close(helper->response_fd);
+    if (kill_it)
+    {
+        kill(helper->pid, SIGKILL);
+        if (waitpid(helper->pid, NULL, WNOHANG) == 0)
+        {
+            pthread_mutex_lock(&abandoned_helpers_lock);
+            if (abandoned_helper_count < MAX_ABANDONED_HELPERS)
+                abandoned_helpers[abandoned_helper_count++] = helper->pid;
+            pthread_mutex_unlock(&abandoned_helpers_lock);
+        }
+    }
+    else
+    {
+        waitpid(helper->pid, NULL, 0);
+    }
+    helper->pid = 0;
+}
+
+bool helper_start_warned = false; // Set once the failure to fork a helper was reported
+
+// Function to run statvfs() for one job in the worker's helper process.
+// Returns the statvfs() result, or -1 with timed_out set when the helper
+// did not answer before the job's deadline and had to be killed. Without a
+// helper the mount fails rather than being probed in-process.
+int probe_isolated(probe_pool_t *pool, probe_helper_t *helper, const probe_job_t *job,
+                   struct statvfs *fs_info, bool *timed_out)
+{
+    *timed_out = false;
+    char path_buffer[MAX_ROOTED_PATH_LENGTH];
+    const char *path = rooted_path(job->mount_point, path_buffer, sizeof(path_buffer));
+    if (helper->pid <= 0 && !probe_helper_start(helper))
+    {
+        // Probing in-process could hang this thread for good, which is what
+        // --isolate is there to prevent; report the mount as failed instead
+        if (!__atomic_exchange_n(&helper_start_warned, true, __ATOMIC_RELAXED))
+            fprintf(stderr, "Cannot start probe helper; isolated mounts are reported as failed\n");
+        return -1;
+    }
+
+    helper_request_t request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.path, sizeof(request.path), "%s", path);
+    if (write(helper->request_fd, &request, sizeof(request)) != (ssize_t)sizeof(request))
+    {
+        probe_helper_stop(helper, true);
+        return -1;
+    }
+
+    // Wait for the per-mount timeout or the global deadline, whichever is first
+    struct timespec limit = job->started;
+    bool has_limit = opt_timeout_ms > 0;
+    timespec_add_ms(&limit, opt_timeout_ms);
+    if (pool->has_deadline && (!has_limit || timespec_diff_ms(&pool->deadline, &limit) > 0))
+    {
+        limit = pool->deadline;
+        has_limit = true;
+    }
+
+    struct pollfd pfd = {.fd = helper->response_fd, .events = POLLIN};
+    for (;;)
+    {
+        int wait_ms = -1;
+        if (has_limit)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long left = timespec_diff_ms(&now, &limit);
+            wait_ms = left > 0 ? (int)left : 0;
+        }
+        int ready = poll(&pfd, 1, wait_ms);
+        if (ready > 0)
+            break;
+        if (ready == 0)
+        {
+            *timed_out = true;
+            probe_helper_stop(helper, true);
+            return -1;
+        }
+        if (errno != EINTR)
+        {
+            probe_helper_stop(helper, true);
+            return -1;
+        }
+    }
+
+    helper_response_t response;
+    if (read(helper->response_fd, &response, sizeof(response)) != (ssize_t)sizeof(response))
+    {
+        probe_helper_stop(helper, true);
+        return -1;
+    }
+    *fs_info = response.fs_info;
+    return response.rc;
+}
+
+// Worker thread: take pending jobs until none are left or the run is abandoned
+void *probe_worker(void *arg)
+{
+    probe_pool_t *pool = arg;
+    probe_helper_t helper = {0};
+
+    // A helper that died makes write() fail with EPIPE instead of killing us
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->abandoned && pool->next < pool->count)
+    {
+        probe_job_t *job = &pool->jobs[pool->next++];
+        job->state = PROBE_RUNNING;
+        clock_gettime(CLOCK_MONOTONIC, &job->started);
+        pthread_mutex_unlock(&pool->lock);
+
+        struct statvfs fs_info;
+        bool timed_out = false;
+        int rc;
+        if (job->isolated)
+        {
+            rc = probe_isolated(pool, &helper, job, &fs_info, &timed_out);
+        }
+        else
+        {
+            char path[MAX_ROOTED_PATH_LENGTH];
+            rc = statvfs(rooted_path(job->mount_point, path, sizeof(path)), &fs_info);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        // The main thread may already have given up on this job
+        if (job->state == PROBE_RUNNING)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            job->state = timed_out ? PROBE_TIMEOUT : rc == 0 ? PROBE_DONE : PROBE_FAILED;
+            job->elapsed_us = timespec_diff_us(&job->started, &now);
+            job->fs_info = fs_info;
+            pool->finished++;
+            pthread_cond_signal(&pool->changed);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    probe_helper_stop(&helper, false);
+    probe_pool_release(pool);
+    return NULL;
+}
+
+// Helper: start one detached worker thread (call with the pool lock held)
+bool probe_pool_spawn(probe_pool_t *pool)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pool->refs++;
+    int rc = pthread_create(&thread, &attr, probe_worker, pool);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        pool->refs--;
+        return false;
+    }
+    pool->threads++;
+    return true;
+}
+
+// Helper: pass the jobs that finished since the last call to on_done. The
+// pool is unlocked meanwhile, so slow output does not hold up the workers.
+void probe_pool_report(probe_pool_t *pool, bool *reported, probe_done_fn on_done, void *context)
+{
+    for (int i = 0; i < pool->count; i++)
+    {
+        probe_state_t state = pool->jobs[i].state;
+        if (reported[i] || state == PROBE_PENDING || state == PROBE_RUNNING)
+            continue;
+        reported[i] = true;
+        probe_job_t job = pool->jobs[i];
+        pthread_mutex_unlock(&pool->lock);
+        on_done(&job, i, context);
+        pthread_mutex_lock(&pool->lock);
+    }
+}
+
+// Function to probe all jobs with statvfs() on a bounded thread pool.
+// Mounts that do not answer within opt_timeout_ms, or that are still
+// pending when the opt_deadline_ms budget runs out, end up as PROBE_TIMEOUT.
+// Returns a copy of the jobs with their final state; the caller frees it.
+// The jobs themselves are left untouched, so they can be probed again.
+// If on_done is given, it sees every job right after it has finished.
+probe_job_t *run_probes(const probe_job_t *jobs, int count, probe_done_fn on_done, void *context)
+{
+    size_t size = (size_t)(count ? count : 1) * sizeof(probe_job_t);
+    probe_job_t *results = malloc(size);
+    probe_job_t *pool_jobs = malloc(size);
+    probe_pool_t *pool = calloc(1, sizeof(probe_pool_t));
+    bool *reported = calloc((size_t)(count ? count : 1), sizeof(bool));
+    if (!results || !pool_jobs || !pool || !reported)
+    {
+        perror("malloc");
+        free(results);
+        free(pool_jobs);
+        free(pool);
+        free(reported);
+        return NULL;
+    }
+    memcpy(pool_jobs, jobs, (size_t)count * sizeof(probe_job_t));
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->jobs = pool_jobs;
+    pool->count = count;
+    pool->refs = 1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timespec_add_ms(&deadline, opt_deadline_ms);
+    pool->deadline = deadline;
+    pool->has_deadline = opt_deadline_ms > 0;
+
+    reap_abandoned_helpers();
+
+    pthread_mutex_lock(&pool->lock);
+    int pool_size = count < PROBE_POOL_SIZE ? count : PROBE_POOL_SIZE;
+    for (int i = 0; i < pool_size; i++)
+    {
+        if (!probe_pool_spawn(pool))
+            break;
+    }
+
+    while (pool->finished < pool->count)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        bool expired = opt_deadline_ms > 0 && timespec_diff_ms(&deadline, &now) >= 0;
+
+        // Find the earliest point at which something can time out
+        struct timespec wake = deadline;
+        bool has_wake = opt_deadline_ms > 0 && !expired;
+        for (int i = 0; i < pool->count; i++)
+        {
+            probe_job_t *job = &pool->jobs[i];
+            if (job->state == PROBE_PENDING && expired)
+            {
+                job->state = PROBE_TIMEOUT;
+                pool->finished++;
+            }
+            else if (job->state == PROBE_RUNNING && job->isolated)
+            {
+                // Isolated jobs enforce their own deadlines and never hang
+                continue;
+            }
+            else if (job->state == PROBE_RUNNING)
+            {
+                struct timespec job_deadline = job->started;
+                timespec_add_ms(&job_deadline, opt_timeout_ms);
+                if (expired || (opt_timeout_ms > 0 && timespec_diff_ms(&job_deadline, &now) >= 0))
+                {
+                    job->state = PROBE_TIMEOUT;
+                    job->elapsed_us = timespec_diff_us(&job->started, &now);
+                    pool->finished++;
+                    pool->stuck++;
+                }
+                else if (opt_timeout_ms > 0 && (!has_wake || timespec_diff_ms(&job_deadline, &wake) > 0))
+                {
+                    wake = job_deadline;
+                    has_wake = true;
+                }
+            }
+        }
+
+        // Replace workers that are stuck so the remaining jobs keep moving
+        while (pool->next < pool->count && pool->threads - pool->stuck < pool_size &&
+               pool->threads < PROBE_MAX_THREADS)
+        {
+            if (!probe_pool_spawn(pool))
+                break;
+        }
+
+        // Nobody is left to run the pending jobs: give up on them
+        if (pool->next < pool->count && pool->threads == pool->stuck)
+        {
+            for (int i = pool->next; i < pool->count; i++)
+            {
+                pool->jobs[i].state = PROBE_TIMEOUT;
+                pool->finished++;
+            }
+            pool->next = pool->count;
+        }
+
+        if (on_done)
+            probe_pool_report(pool, reported, on_done, context);
+        if (pool->finished >= pool->count)
+            break;
+        if (has_wake)
+            pthread_cond_timedwait(&pool->changed, &pool->lock, &wake);
+        else
+            pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+
+    if (on_done)
+        probe_pool_report(pool, reported, on_done, context);
+    pool->abandoned = true;
+    memcpy(results, pool->jobs, (size_t)count * sizeof(probe_job_t));
+    free(reported);
+    pthread_mutex_unlock(&pool->lock);
+
+    probe_pool_release(pool);
+    return results;
+}
+
+// Helper: hash slot of a device number in the disk index
+size_t disk_index_slot(const disk_index_t *index, dev_t rdev)
+{
+    unsigned long long h = (unsigned long long)rdev * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h ^ (h >> 32)) & (index->capacity - 1);
+}
+
+// Function to find or insert the entry for a device number
+disk_ids_t *disk_index_get(disk_index_t *index, dev_t rdev, bool insert)
+{
+    if (index->capacity == 0)
+    {
+        if (!insert)
+            return NULL;
+        index->slots = calloc(DISK_INDEX_INITIAL_CAPACITY, sizeof(disk_ids_t));
+        if (!index->slots)
+            return NULL;
+        index->capacity = DISK_INDEX_INITIAL_CAPACITY;
+    }
+
+    size_t slot = disk_index_slot(index, rdev);
+    while (index->slots[slot].used)
+    {
+        if (index->slots[slot].rdev == rdev)
+            return &index->slots[slot];
+        slot = (slot + 1) & (index->capacity - 1);
+    }
+    if (!insert)
+        return NULL;
+
+    // Grow before the table gets too crowded, then insert into the new one
+    if ((index->count + 1) * 100 > index->capacity * DISK_INDEX_MAX_LOAD_PERCENT)
+    {
+        disk_index_t grown = {0};
+        grown.capacity = index->capacity * 2;
+        grown.slots = calloc(grown.capacity, sizeof(disk_ids_t));
+        if (!grown.slots)
+            return NULL;
+        for (size_t i = 0; i < index->capacity; i++)
+        {
+            if (!index->slots[i].used)
+                continue;
+            size_t s = disk_index_slot(&grown, index->slots[i].rdev);
+            while (grown.slots[s].used)
+                s = (s + 1) & (grown.capacity - 1);
+            grown.slots[s] = index->slots[i];
+        }
+        free(index->slots);
+        index->slots = grown.slots;
+        index->capacity = grown.capacity;
+        return disk_index_get(index, rdev, true);
+    }
+
+    index->slots[slot].used = true;
+    index->slots[slot].rdev = rdev;
+    index->count++;
+    return &index->slots[slot];
+}
+
+// Function to read one /dev/disk/by-* directory into the index. Each link
+// costs a single fstatat() that follows it to the block device.
+void disk_index_scan(disk_index_t *index, const char *subdir, size_t field_offset)
+{
+    char dir_path[MAX_PATH_LENGTH], rooted[MAX_ROOTED_PATH_LENGTH];
+    snprintf(dir_path, sizeof(dir_path), "%s/%s", DISK_BY_DIR, subdir);
+    DIR *dir = opendir(rooted_path(dir_path, rooted, sizeof(rooted)));
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISBLK(st.st_mode))
+            continue;
+        disk_ids_t *ids = disk_index_get(index, st.st_rdev, true);
+        if (!ids)
+            break;
+
+        // A device can have several links (by-id especially); keep the
+        // alphabetically first one so the output is stable
+        char *field = (char *)ids + field_offset;
+        if (field[0] == '\0' || strcmp(entry->d_name, field) < 0)
+            snprintf(field, MAX_DISK_ID_LENGTH, "%s", entry->d_name);
+    }
+    closedir(dir);
+}
+
+// Function to drop the index so the next lookup rereads /dev/disk
+void disk_index_reset(disk_index_t *index)
+{
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+}
+
+// Function to build the udev symlink index on first use
+void disk_index_load(disk_index_t *index)
+{
+    if (index->loaded)
+        return;
+    index->loaded = true;
+    disk_index_scan(index, "by-uuid", offsetof(disk_ids_t, uuid));
+    disk_index_scan(index, "by-label", offsetof(disk_ids_t, label));
+    disk_index_scan(index, "by-partuuid", offsetof(disk_ids_t, partuuid));
+    disk_index_scan(index, "by-id", offsetof(disk_ids_t, disk_id));
+    disk_index_scan(index, "by-path", offsetof(disk_ids_t, disk_path));
+}
+
+// Helpers: little-endian field access in a superblock buffer
+unsigned int sb_le16(const unsigned char *p)
+{
+    return (unsigned int)p[0] | (unsigned int)p[1] << 8;
+}
+
+unsigned long sb_le32(const unsigned char *p)
+{
+    return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+           (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+// Helper: format 16 raw bytes as a canonical 8-4-4-4-12 UUID
+void sb_format_uuid(const unsigned char *raw, char *out, size_t out_size)
+{
+    snprintf(out, out_size,
+             "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             raw[0], raw[1], raw[2], raw[3], raw[4], raw[5], raw[6], raw[7],
+             raw[8], raw[9], raw[10], raw[11], raw[12], raw[13], raw[14], raw[15]);
+}
+
+// Helper: copy a fixed-width label field, dropping NUL and space padding
+void sb_copy_label(const unsigned char *raw, size_t raw_size, char *out, size_t out_size)
+{
+    size_t len = 0;
+    while (len < raw_size && raw[len] != '\0')
+        len++;
+    while (len > 0 && raw[len - 1] == ' ')
+        len--;
+    if (len >= out_size)
+        len = out_size - 1;
+    memcpy(out, raw, len);
+    out[len] = '\0';
+}
+
+// Helper: FAT and exFAT volume serials are shown as XXXX-XXXX
+void sb_format_serial(unsigned long serial, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%04lX-%04lX", (serial >> 16) & 0xFFFF, serial & 0xFFFF);
+}
+
+// Function to read the exFAT volume label from the root directory
+void sb_read_exfat_label(int fd, const unsigned char *boot, char *out, size_t out_size)
+{
+    unsigned int sector_shift = boot[0x6C];
+    unsigned int cluster_shift = boot[0x6D];
+    unsigned long heap_offset = sb_le32(boot + 0x58);
+    unsigned long root_cluster = sb_le32(boot + 0x60);
+    if (sector_shift < 9 || sector_shift > 12 || sector_shift + cluster_shift > 25 || root_cluster < 2)
+        return;
+
+    off_t root = ((off_t)heap_offset << sector_shift) +
+                 ((off_t)(root_cluster - 2) << (sector_shift + cluster_shift));
+    unsigned char dir[SB_EXFAT_MAX_ROOT_READ];
+    ssize_t got = pread(fd, dir, sizeof(dir), root);
+    for (ssize_t i = 0; i + 32 <= got; i += 32)
+    {
+        if (dir[i] == 0x00)
+            break;
+        if (dir[i] != 0x83) // Volume label entry
+            continue;
+
+        // Up to 11 UTF-16LE characters, converted to UTF-8
+        unsigned int chars = dir[i + 1] > 11 ? 11 : dir[i + 1];
+        size_t len = 0;
+        for (unsigned int c = 0; c < chars; c++)
+        {
+            unsigned int cp = sb_le16(dir + i + 2 + c * 2);
+            if (cp < 0x80 && len + 1 < out_size)
+            {
+                out[len++] = (char)cp;
+            }
+            else if (cp < 0x800 && len + 2 < out_size)
+            {
+                out[len++] = (char)(0xC0 | cp >> 6);
+                out[len++] = (char)(0x80 | (cp & 0x3F));
+            }
+            else if (cp >= 0x800 && len + 3 < out_size)
+            {
+                out[len++] = (char)(0xE0 | cp >> 12);
+                out[len++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                out[len++] = (char)(0x80 | (cp & 0x3F));
+            }
+        }
+        out[len] = '\0';
+        return;
+    }
+}
+
+// Function to identify a filesystem by reading its superblock directly.
+// Works on block devices as well as on image files and only reads the few
+// KB that hold the superblocks of ext2/3/4, XFS, btrfs, vfat, exFAT and swap.
+bool read_superblock_ids(const char *path, superblock_ids_t *ids)
+{
+    memset(ids, 0, sizeof(*ids));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    unsigned char head[SB_HEAD_SIZE];
+    ssize_t got = pread(fd, head, sizeof(head), 0);
+    if (got < 0)
+        got = 0;
+    memset(head + got, 0, sizeof(head) - (size_t)got);
+
+    const unsigned char *ext = head + SB_EXT_OFFSET;
+    bool boot_signature = head[510] == 0x55 && head[511] == 0xAA;
+    long page_size = sysconf(_SC_PAGESIZE);
+    unsigned char swap_signature[SB_SWAP_SIGNATURE_LENGTH] = {0};
+    if (page_size == SB_HEAD_SIZE)
+        memcpy(swap_signature, head + SB_HEAD_SIZE - SB_SWAP_SIGNATURE_LENGTH, SB_SWAP_SIGNATURE_LENGTH);
+    else if (page_size > SB_SWAP_SIGNATURE_LENGTH)
+        pread(fd, swap_signature, sizeof(swap_signature), page_size - SB_SWAP_SIGNATURE_LENGTH);
+
+    if (memcmp(head, "XFSB", 4) == 0)
+    {
+        snprintf(ids->type, sizeof(ids->type), "xfs");
+        sb_format_uuid(head + 32, ids->uuid, sizeof(ids->uuid));
+        sb_copy_label(head + 108, 12, ids->label, sizeof(ids->label));
+    }
+    else if (sb_le16(ext + 0x38) == SB_EXT_MAGIC)
+    {
+        unsigned long compat = sb_le32(ext + 0x5C);
+        unsigned long incompat = sb_le32(ext + 0x60);
+        // extents, 64bit or flex_bg mean ext4; a journal alone means ext3
+        const char *type = (incompat & 0x2C0) ? "ext4" : (compat & 0x4) ? "ext3" : "ext2";
+        snprintf(ids->type, sizeof(ids->type), "%s", type);
+        sb_format_uuid(ext + 0x68, ids->uuid, sizeof(ids->uuid));
+        sb_copy_label(ext + 0x78, 16, ids->label, sizeof(ids->label));
+    }
+    else if (memcmp(head + 3, "EXFAT   ", 8) == 0)
+    {
+        snprintf(ids->type, sizeof(ids->type), "exfat");
+        sb_format_serial(sb_le32(head + 0x64), ids->uuid, sizeof(ids->uuid));
+        sb_read_exfat_label(fd, head, ids->label, sizeof(ids->label));
+    }
+    else if (boot_signature && memcmp(head + 0x52, "FAT32   ", 8) == 0)
+    {
+        snprintf(ids->type, sizeof(ids->type), "vfat");
+        sb_format_serial(sb_le32(head + 0x43), ids->uuid, sizeof(ids->uuid));
+        sb_copy_label(head + 0x47, 11, ids->label, sizeof(ids->label));
+    }
+    else if (boot_signature && (memcmp(head + 0x36, "FAT12   ", 8) == 0 ||
+                                memcmp(head + 0x36, "FAT16   ", 8) == 0))
+    {
+        snprintf(ids->type, sizeof(ids->type), "vfat");
+        sb_format_serial(sb_le32(head + 0x27), ids->uuid, sizeof(ids->uuid));
+        sb_copy_label(head + 0x2B, 11, ids->label, sizeof(ids->label));
+    }
+    else if (memcmp(swap_signature, "SWAPSPACE2", SB_SWAP_SIGNATURE_LENGTH) == 0)
+    {
+        snprintf(ids->type, sizeof(ids->type), "swap");
+        sb_format_uuid(head + 1024 + 12, ids->uuid, sizeof(ids->uuid));
+        sb_copy_label(head + 1024 + 28, 16, ids->label, sizeof(ids->label));
+    }
+    else
+    {
+        unsigned char btrfs[SB_BTRFS_SIZE];
+        if (pread(fd, btrfs, sizeof(btrfs), SB_BTRFS_OFFSET) == (ssize_t)sizeof(btrfs) &&
+            memcmp(btrfs + 0x40, "_BHRfS_M", 8) == 0)
+        {
+            snprintf(ids->type, sizeof(ids->type), "btrfs");
+            sb_format_uuid(btrfs + 0x20, ids->uuid, sizeof(ids->uuid));
+            sb_copy_label(btrfs + 0x12B, 256, ids->label, sizeof(ids->label));
+        }
+    }
+
+    close(fd);
+
+    // FAT marks an unset label this way
+    if (strcmp(ids->label, "NO NAME") == 0)
+        ids->label[0] = '\0';
+    return ids->type[0] != '\0';
+}
+
+// Function to look up the udev names of a device node in O(1). Devices
+// without udev links (containers, initramfs) fall back to their superblock.
+const disk_ids_t *find_disk_ids(const char *device)
+{
+    struct stat st;
+    char rooted[MAX_ROOTED_PATH_LENGTH];
+    if (device[0] != '/')
+        return NULL;
+    device = rooted_path(device, rooted, sizeof(rooted));
+    if (stat(device, &st) != 0 || !S_ISBLK(st.st_mode))
+        return NULL;
+    disk_index_load(&disk_index);
+    disk_ids_t *ids = disk_index_get(&disk_index, st.st_rdev, false);
+    if (ids && (ids->uuid[0] || ids->label[0]))
+        return ids;
+
+    if (!ids)
+        ids = disk_index_get(&disk_index, st.st_rdev, true);
+    if (ids && !ids->superblock_read)
+    {
+        ids->superblock_read = true;
+        superblock_ids_t sb;
+        if (read_superblock_ids(device, &sb))
+        {
+            snprintf(ids->uuid, sizeof(ids->uuid), "%s", sb.uuid);
+            snprintf(ids->label, sizeof(ids->label), "%s", sb.label);
+        }
+    }
+    return ids;
+}
+
+// Function to print what the superblock reader finds in a device or image
+// file, in the style of blkid(8). Returns the process exit code.
+int identify_filesystem(const char *path)
+{
+    superblock_ids_t sb;
+    if (!read_superblock_ids(path, &sb))
+    {
+        fprintf(stderr, "%s: no known filesystem found\n", path);
+        return 2;
+    }
+    printf("%s: TYPE=\"%s\"", path, sb.type);
+    if (sb.uuid[0])
+        printf(" UUID=\"%s\"", sb.uuid);
+    if (sb.label[0])
+        printf(" LABEL=\"%s\"", sb.label);
+    printf("\n");
+    return 0;
+}
+
+// A whole disk whose SMART data is collected once for all its partitions
+typedef struct
+{
+    char disk[MAX_ROOTED_PATH_LENGTH]; // e.g. /dev/sda
+    char name[NAME_MAX + 1];    // e.g. sda
+    smart_info_t info;
+    bool done;
+    pid_t pid;
+    int fd;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+    struct timespec started;
+} smart_job_t;
+
+// State for turning smartctl JSON into a smart_info_t
+typedef struct
+{
+    smart_info_t *info;
+    long attr_index; // Current entry of ata_smart_attributes.table
+    long long attr_id;
+    long long attr_value;
+    long long attr_raw;
+} smart_parse_t;
+
+typedef void (*json_visit_fn)(const char *path, const char *value, size_t length, void *ctx);
+
+// Helper: skip JSON whitespace
+const char *json_skip_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    return p;
+}
+
+// Helper: find the closing quote of a JSON string starting after the opening one
+const char *json_string_end(const char *p, const char *end)
+{
+    while (p < end && *p != '"')
+        p += (*p == '\\') ? 2 : 1;
+    return p < end ? p : NULL;
+}
+
+// Helper: value of the 4 hex digits at p, or -1
+long json_hex4(const char *p, const char *end)
+{
+    if (end - p < 4)
+        return -1;
+    long value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = p[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0)
+            return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Helper: encode a code point as UTF-8, returns the number of bytes
+size_t utf8_encode(long code, char *bytes)
+{
+    if (code < 0x80)
+    {
+        bytes[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        bytes[0] = (char)(0xC0 | code >> 6);
+        bytes[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        bytes[0] = (char)(0xE0 | code >> 12);
+        bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    bytes[0] = (char)(0xF0 | code >> 18);
+    bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    bytes[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Function to decode the escapes of the JSON string between p and end into
+// out, \uXXXX (and surrogate pairs) as UTF-8. Unknown escapes are kept as
+// they are; a value that does not fit is cut before the character that
+// overflows. Returns the decoded length.
+size_t json_unescape(const char *p, const char *end, char *out, size_t size)
+{
+    size_t length = 0;
+    while (p < end)
+    {
+        char bytes[4] = {*p++};
+        size_t count = 1;
+        if (bytes[0] == '\\' && p < end)
+        {
+            char c = *p++;
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                bytes[0] = c;
+                break;
+            case 'b':
+                bytes[0] = '\b';
+                break;
+            case 'f':
+                bytes[0] = '\f';
+                break;
+            case 'n':
+                bytes[0] = '\n';
+                break;
+            case 'r':
+                bytes[0] = '\r';
+                break;
+            case 't':
+                bytes[0] = '\t';
+                break;
+            case 'u':
+            {
+                long code = json_hex4(p, end);
+                if (code < 0)
+                {
+                    p--; // Not an escape after all
+                    break;
+                }
+                p += 4;
+                if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                {
+                    long low = json_hex4(p + 2, end);
+                    if (low >= 0xDC00 && low < 0xE000)
+                    {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                if (code >= 0xD800 && code < 0xE000)
+                    code = 0xFFFD; // Unpaired surrogate
+                count = utf8_encode(code, bytes);
+                break;
+            }
+            default:
+                p--;
+                break;
+            }
+        }
+        if (length + count > size)
+            break;
+        memcpy(out + length, bytes, count);
+        length += count;
+    }
+    return length;
+}
+
+// Function to walk a JSON document and call visit() for every scalar with
+// its dotted path, e.g. "ata_smart_attributes.table[3].raw.value". Strings
+// are passed without quotes and with their escapes decoded, cut to
+// MAX_JSON_STRING_LENGTH bytes. Returns the position after the
+// value, or NULL on malformed input.
+const char *json_walk(const char *p, const char *end, char *path, size_t path_length,
+                      int depth, json_visit_fn visit, void *ctx)
+{
+    p = json_skip_ws(p, end);
+    if (p >= end || depth > MAX_JSON_DEPTH)
+        return NULL;
+
+    if (*p == '{' || *p == '[')
+    {
+        bool is_object = *p == '{';
+        char close = is_object ? '}' : ']';
+        long index = 0;
+        p = json_skip_ws(p + 1, end);
+        if (p < end && *p == close)
+            return p + 1;
+        for (;;)
+        {
+            size_t length = path_length;
+            if (is_object)
+            {
+                if (p >= end || *p != '"')
+                    return NULL;
+                const char *key = p + 1;
+                const char *key_end = json_string_end(key, end);
+                if (!key_end)
+                    return NULL;
+                int n = snprintf(path + path_length, MAX_JSON_PATH_LENGTH - path_length, "%s%.*s",
+                                 path_length ? "." : "", (int)(key_end - key), key);
+                length += n > 0 ? (size_t)n : 0;
+                p = json_skip_ws(key_end + 1, end);
+                if (p >= end || *p != ':')
+                    return NULL;
+                p++;
+            }
+            else
+            {
+                int n = snprintf(path + path_length, MAX_JSON_PATH_LENGTH - path_length, "[%ld]", index++);
+                length += n > 0 ? (size_t)n : 0;
+            }
+            if (length >= MAX_JSON_PATH_LENGTH)
+                length = MAX_JSON_PATH_LENGTH - 1;
+
+            p = json_walk(p, end, path, length, depth + 1, visit, ctx);
+            path[path_length] = '\0';
+            if (!p)
+                return NULL;
+            p = json_skip_ws(p, end);
+            if (p < end && *p == ',')
+            {
+                p = json_skip_ws(p + 1, end);
+                continue;
+            }
+            if (p < end && *p == close)
+                return p + 1;
+            return NULL;
+        }
+    }
+
+    if (*p == '"')
+    {
+        const char *value_end = json_string_end(p + 1, end);
+        if (!value_end)
+            return NULL;
+        char value[MAX_JSON_STRING_LENGTH];
+        visit(path, value, json_unescape(p + 1, value_end, value, sizeof(value)), ctx);
+        return value_end + 1;
+    }
+
+    // Number, true, false or null
+    const char *value = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        p++;
+    visit(path, value, (size_t)(p - value), ctx);
+    return p;
+}
+
+// Helper: parse an integer JSON value
+long long json_to_ll(const char *value, size_t length)
+{
+    char buffer[32];
+    if (length >= sizeof(buffer))
+        length = sizeof(buffer) - 1;
+    memcpy(buffer, value, length);
+    buffer[length] = '\0';
+    return strtoll(buffer, NULL, 10);
+}
+
+// Helper: apply one finished ATA attribute to the SMART info
+void smart_commit_attribute(smart_parse_t *parse)
+{
+    smart_info_t *info = parse->info;
+    switch (parse->attr_id)
+    {
+    case 5: // Reallocated_Sector_Ct
+        info->reallocated_sectors = parse->attr_raw;
+        break;
+    case 9: // Power_On_Hours
+        if (info->power_on_hours == SMART_UNKNOWN)
+            info->power_on_hours = parse->attr_raw;
+        break;
+    case 177: // Wear_Leveling_Count
+    case 231: // SSD_Life_Left
+    case 233: // Media_Wearout_Indicator
+        if (info->percentage_used == SMART_UNKNOWN && parse->attr_value >= 0 && parse->attr_value <= 100)
+            info->percentage_used = 100 - parse->attr_value;
+        break;
+    case 194: // Temperature_Celsius
+        if (info->temperature == SMART_UNKNOWN)
+            info->temperature = parse->attr_raw & 0xFF;
+        break;
+    }
+    parse->attr_id = SMART_UNKNOWN;
+    parse->attr_value = SMART_UNKNOWN;
+    parse->attr_raw = 0;
+}
+
+// Visitor for smartctl -j output
+void smart_visit(const char *path, const char *value, size_t length, void *ctx)
+{
+    smart_parse_t *parse = ctx;
+    smart_info_t *info = parse->info;
+    const char *table = "ata_smart_attributes.table[";
+
+    if (strcmp(path, "smart_status.passed") == 0)
+        snprintf(info->status, sizeof(info->status), "%s",
+                 length == 4 && strncmp(value, "true", 4) == 0 ? "PASSED" : "FAILED");
+    else if (strcmp(path, "temperature.current") == 0)
+        info->temperature = json_to_ll(value, length);
+    else if (strcmp(path, "power_on_time.hours") == 0)
+        info->power_on_hours = json_to_ll(value, length);
+    else if (strcmp(path, "nvme_smart_health_information_log.percentage_used") == 0)
+        info->percentage_used = json_to_ll(value, length);
+    else if (strncmp(path, table, strlen(table)) == 0)
+    {
+        char *field;
+        long index = strtol(path + strlen(table), &field, 10);
+        if (index != parse->attr_index)
+        {
+            if (parse->attr_index >= 0)
+                smart_commit_attribute(parse);
+            parse->attr_index = index;
+        }
+        if (strcmp(field, "].id") == 0)
+            parse->attr_id = json_to_ll(value, length);
+        else if (strcmp(field, "].value") == 0)
+            parse->attr_value = json_to_ll(value, length);
+        else if (strcmp(field, "].raw.value") == 0)
+            parse->attr_raw = json_to_ll(value, length);
+    }
+}
+
+// Helper: reset SMART info to "nothing known"
+void init_smart_info(smart_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->temperature = SMART_UNKNOWN;
+    info->power_on_hours = SMART_UNKNOWN;
+    info->percentage_used = SMART_UNKNOWN;
+    info->reallocated_sectors = SMART_UNKNOWN;
+}
+
+// Function to parse smartctl -j output. Returns false if nothing useful was found.
+bool parse_smartctl_json(const char *json, size_t length, smart_info_t *info)
+{
+    init_smart_info(info);
+
+    smart_parse_t parse = {info, -1, SMART_UNKNOWN, SMART_UNKNOWN, 0};
+    char path[MAX_JSON_PATH_LENGTH] = "";
+    json_walk(json, json + length, path, 0, 0, smart_visit, &parse);
+    if (parse.attr_index >= 0)
+        smart_commit_attribute(&parse);
+
+    return info->status[0] || info->temperature != SMART_UNKNOWN ||
+           info->power_on_hours != SMART_UNKNOWN || info->percentage_used != SMART_UNKNOWN;
+}
+
+// Function to map a partition to the whole disk that holds it via sysfs,
+// e.g. /dev/nvme0n1p2 -> /dev/nvme0n1. Whole disks map to themselves.
+// Below --root, disk is the prefixed device node smartctl has to open.
+bool get_parent_disk(const char *device, char *disk, size_t disk_size, char *name, size_t name_size)
+{
+    char rooted[MAX_ROOTED_PATH_LENGTH], resolved[PATH_MAX];
+    size_t root_length = strlen(system_root);
+    if (!realpath(rooted_path(device, rooted, sizeof(rooted)), resolved) ||
+        strncmp(resolved, system_root, root_length) != 0 || strncmp(resolved + root_length, "/dev/", 5) != 0)
+        return false;
+    const char *base = resolved + root_length + 5;
+
+    char sys_path[MAX_PATH_LENGTH + PATH_MAX + sizeof(SYS_CLASS_BLOCK "//partition")], sys_resolved[PATH_MAX];
+    snprintf(sys_path, sizeof(sys_path), "%s" SYS_CLASS_BLOCK "/%s/partition", system_root, base);
+    if (access(sys_path, F_OK) == 0)
+    {
+        // The partition directory lives inside the directory of its disk
+        snprintf(sys_path, sizeof(sys_path), "%s" SYS_CLASS_BLOCK "/%s", system_root, base);
+        if (!realpath(sys_path, sys_resolved))
+            return false;
+        snprintf(name, name_size, "%s", basename(dirname(sys_resolved)));
+    }
+    else
+    {
+        snprintf(sys_path, sizeof(sys_path), "%s" SYS_CLASS_BLOCK "/%s", system_root, base);
+        if (access(sys_path, F_OK) == 0)
+        {
+            snprintf(name, name_size, "%s", base);
+        }
+        else
+        {
+            // No sysfs: strip the partition number by naming convention
+            size_t len = strlen(base);
+            while (len > 0 && base[len - 1] >= '0' && base[len - 1] <= '9')
+                len--;
+            bool p_suffix = len > 1 && base[len - 1] == 'p' && base[len - 2] >= '0' && base[len - 2] <= '9';
+            if (p_suffix)
+                len--; // nvme0n1p2, mmcblk0p1
+            else if (strncmp(base, "nvme", 4) == 0 || strncmp(base, "mmcblk", 6) == 0)
+                len = strlen(base);
+            snprintf(name, name_size, "%.*s", (int)len, base);
+        }
+    }
+    snprintf(disk, disk_size, "%s/dev/%s", system_root, name);
+    return true;
+}
+
+// Helper: read the boot ID, which invalidates cached SMART data after a
+// reboot (device names may have moved)
+void read_boot_id(char *boot_id, size_t size)
+{
+    boot_id[0] = '\0';
+    char rooted[MAX_ROOTED_PATH_LENGTH];
+    FILE *fp = fopen(rooted_path(BOOT_ID_PATH, rooted, sizeof(rooted)), "r");
+    if (!fp)
+        return;
+    if (fgets(boot_id, (int)size, fp))
+        boot_id[strcspn(boot_id, "\n")] = '\0';
+    fclose(fp);
+}
+
+// Function to load cached SMART data if it is younger than opt_smart_ttl
+bool read_smart_cache(const char *name, const char *boot_id, smart_info_t *info)
+{
+    char path[MAX_PATH_LENGTH];
+    snprintf(path, sizeof(path), SMART_CACHE_DIR "/smart-%s.cache", name);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return false;
+
+    init_smart_info(info);
+    char line[MAX_TEMP_BUFFER_LENGTH], cached_boot_id[MAX_BOOT_ID_LENGTH] = "";
+    long long when = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        char *value = strchr(line, '=');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        if (strcmp(line, "boot_id") == 0)
+            snprintf(cached_boot_id, sizeof(cached_boot_id), "%s", value);
+        else if (strcmp(line, "time") == 0)
+            when = strtoll(value, NULL, 10);
+        else if (strcmp(line, "status") == 0)
+            snprintf(info->status, sizeof(info->status), "%s", value);
+        else if (strcmp(line, "temperature") == 0)
+            info->temperature = strtoll(value, NULL, 10);
+        else if (strcmp(line, "power_on_hours") == 0)
+            info->power_on_hours = strtoll(value, NULL, 10);
+        else if (strcmp(line, "percentage_used") == 0)
+            info->percentage_used = strtoll(value, NULL, 10);
+        else if (strcmp(line, "reallocated_sectors") == 0)
+            info->reallocated_sectors = strtoll(value, NULL, 10);
+    }
+    fclose(fp);
+
+    long long age = (long long)time(NULL) - when;
+    return when > 0 && age >= 0 && age < opt_smart_ttl && strcmp(cached_boot_id, boot_id) == 0;
+}
+
+// Function to store SMART data in the cache (written to a temporary file
+// and renamed, so concurrent runs never see a partial file)
+void write_smart_cache(const char *name, const char *boot_id, const smart_info_t *info)
+{
+    char path[MAX_PATH_LENGTH], tmp_path[MAX_PATH_LENGTH + MAX_SIZE_STR_LENGTH];
+    snprintf(path, sizeof(path), SMART_CACHE_DIR "/smart-%s.cache", name);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+    mkdir(SMART_CACHE_DIR, 0755);
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp)
+        return;
+    fprintf(fp, "boot_id=%s\ntime=%lld\nstatus=%s\n", boot_id, (long long)time(NULL), info->status);
+    fprintf(fp, "temperature=%lld\npower_on_hours=%lld\n", info->temperature, info->power_on_hours);
+    fprintf(fp, "percentage_used=%lld\nreallocated_sectors=%lld\n", info->percentage_used, info->reallocated_sectors);
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+        unlink(tmp_path);
+}
+
+// Function to start smartctl -j for one disk with its stdout on a pipe
+bool smart_job_start(smart_job_t *job)
+{
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0)
+        return false;
+
+    extern char **environ;
+    char *argv[] = {"smartctl", "-j", "-H", "-A", job->disk, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    int rc = posix_spawnp(&job->pid, "smartctl", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out_pipe[1]);
+    if (rc != 0)
+    {
+        close(out_pipe[0]);
+        return false;
+    }
+    job->fd = out_pipe[0];
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    return true;
+}
+
+// Function to finish a smartctl run: reap it and parse what it printed
+void smart_job_finish(smart_job_t *job, bool timed_out)
+{
+    close(job->fd);
+    job->fd = -1;
+    if (timed_out)
+    {
+        // A disk that hangs can leave smartctl in D state: do not wait for it
+        kill(job->pid, SIGKILL);
+        if (waitpid(job->pid, NULL, WNOHANG) == 0)
+        {
+            pthread_mutex_lock(&abandoned_helpers_lock);
+            if (abandoned_helper_count < MAX_ABANDONED_HELPERS)
+                abandoned_helpers[abandoned_helper_count++] = job->pid;
+            pthread_mutex_unlock(&abandoned_helpers_lock);
+        }
+    }
+    else
+    {
+        waitpid(job->pid, NULL, 0);
+        parse_smartctl_json(job->output, job->output_length, &job->info);
+    }
+    free(job->output);
+    job->output = NULL;
+    job->done = true;
+}
+
+// Function to run smartctl for all jobs, at most SMART_MAX_PARALLEL at a
+// time, killing runs that exceed opt_timeout_ms
+void run_smart_jobs(smart_job_t *jobs, int count)
+{
+    int next = 0, running = 0;
+    struct pollfd pfds[SMART_MAX_PARALLEL];
+    smart_job_t *active[SMART_MAX_PARALLEL];
+
+    for (;;)
+    {
+        while (running < SMART_MAX_PARALLEL && next < count)
+        {
+            smart_job_t *job = &jobs[next++];
+            if (job->done)
+                continue;
+            if (!smart_job_start(job))
+            {
+                job->done = true;
+                continue;
+            }
+            active[running++] = job;
+        }
+        if (running <= 0)
+            break;
+
+        // Sleep until output arrives or the oldest run hits its timeout
+        int wait_ms = -1;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < running; i++)
+        {
+            pfds[i].fd = active[i]->fd;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+            if (opt_timeout_ms > 0)
+            {
+                long long left = opt_timeout_ms - timespec_diff_ms(&active[i]->started, &now);
+                if (left < 0)
+                    left = 0;
+                if (wait_ms < 0 || left < wait_ms)
+                    wait_ms = (int)left;
+            }
+        }
+        if (poll(pfds, running, wait_ms) < 0 && errno != EINTR)
+            break;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        for (int i = running - 1; i >= 0; i--)
+        {
+            smart_job_t *job = active[i];
+            bool finished = false, timed_out = false;
+            if (pfds[i].revents)
+            {
+                if (job->output_capacity - job->output_length < SMART_READ_CHUNK)
+                {
+                    size_t capacity = job->output_capacity ? job->output_capacity * 2 : SMART_READ_CHUNK * 4;
+                    char *grown = capacity <= SMART_OUTPUT_LIMIT ? realloc(job->output, capacity) : NULL;
+                    if (!grown)
+                    {
+                        finished = timed_out = true;
+                    }
+                    else
+                    {
+                        job->output = grown;
+                        job->output_capacity = capacity;
+                    }
+                }
+                if (!finished)
+                {
+                    ssize_t got = read(job->fd, job->output + job->output_length, SMART_READ_CHUNK);
+                    if (got > 0)
+                        job->output_length += (size_t)got;
+                    else if (got == 0 || errno != EINTR)
+                        finished = true;
+                }
+            }
+            if (!finished && opt_timeout_ms > 0 && timespec_diff_ms(&job->started, &now) >= opt_timeout_ms)
+                finished = timed_out = true;
+            if (finished)
+            {
+                smart_job_finish(job, timed_out);
+                active[i] = active[--running];
+            }
+        }
+    }
+
+    // Only reached early if poll() itself failed
+    for (int i = 0; i < running; i++)
+        smart_job_finish(active[i], true);
+}
+
+// Function to collect SMART data for all local drives (root only). Every
+// whole disk is queried once, in parallel, and cached for opt_smart_ttl.
+void collect_smart_info(drive_table_t *table)
+{
+    int count = table->count;
+    if (geteuid() != 0 || count == 0 || !(opt_fields & FIELD_SMART))
+        return;
+
+    smart_job_t *jobs = calloc((size_t)count, sizeof(smart_job_t));
+    int *owner = malloc((size_t)count * sizeof(int));
+    if (!jobs || !owner)
+    {
+        free(jobs);
+        free(owner);
+        return;
+    }
+
+    int job_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        owner[i] = -1;
+        drive_info_t *drive = &table->info[i];
+        if (drive->is_cloud_storage || strcmp(drive->drive_type, "Local Drive") != 0)
+            continue;
+
+        char disk[MAX_ROOTED_PATH_LENGTH], name[NAME_MAX + 1];
+        if (!get_parent_disk(drive->device, disk, sizeof(disk), name, sizeof(name)))
+            continue;
+        drive->has_smart = true;
+        for (int j = 0; j < job_count && owner[i] < 0; j++)
+        {
+            if (strcmp(jobs[j].disk, disk) == 0)
+                owner[i] = j;
+        }
+        if (owner[i] < 0)
+        {
+            smart_job_t *job = &jobs[job_count];
+            snprintf(job->disk, sizeof(job->disk), "%s", disk);
+            snprintf(job->name, sizeof(job->name), "%s", name);
+            job->fd = -1;
+            init_smart_info(&job->info);
+            owner[i] = job_count++;
+        }
+    }
+
+    char boot_id[MAX_BOOT_ID_LENGTH];
+    read_boot_id(boot_id, sizeof(boot_id));
+    bool *from_cache = calloc((size_t)(job_count ? job_count : 1), sizeof(bool));
+    for (int j = 0; j < job_count && opt_smart_ttl > 0 && from_cache; j++)
+        from_cache[j] = jobs[j].done = read_smart_cache(jobs[j].name, boot_id, &jobs[j].info);
+
+    run_smart_jobs(jobs, job_count);
+
+    for (int j = 0; j < job_count && opt_smart_ttl > 0 && from_cache; j++)
+    {
+        if (!from_cache[j] && jobs[j].info.status[0])
+            write_smart_cache(jobs[j].name, boot_id, &jobs[j].info);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (owner[i] >= 0)
+            table->info[i].smart = jobs[owner[i]].info;
+    }
+
+    free(from_cache);
+    free(owner);
+    free(jobs);
+}
+
+// Function to summarize SMART data in one line, e.g. "PASSED, 34 °C, 1200 h"
+void format_smart_summary(const smart_info_t *info, char *buffer, size_t size)
+{
+    int n = snprintf(buffer, size, "%s", info->status[0] ? info->status : "No data");
+    if (info->temperature != SMART_UNKNOWN && (size_t)n < size)
+        n += snprintf(buffer + n, size - n, ", %lld °C", info->temperature);
+    if (info->power_on_hours != SMART_UNKNOWN && (size_t)n < size)
+        n += snprintf(buffer + n, size - n, ", %lld h powered on", info->power_on_hours);
+    if (info->percentage_used != SMART_UNKNOWN && (size_t)n < size)
+        n += snprintf(buffer + n, size - n, ", %lld%% worn", info->percentage_used);
+    if (info->reallocated_sectors != SMART_UNKNOWN && (size_t)n < size)
+        snprintf(buffer + n, size - n, ", %lld reallocated sectors", info->reallocated_sectors);
+}
+
+// Helper: append one SMART value for render_json_drive(), null if unknown
+void render_json_smart_value(strbuf_t *out, const char *key, long long value)
+{
+    strbuf_append_str(out, ", ");
+    json_append_string(out, key);
+    strbuf_append_str(out, ": ");
+    if (value == SMART_UNKNOWN)
+        strbuf_append_str(out, "null");
+    else
+        json_append_int(out, value);
+}
+
+// Helper: append the key of the next member of a drive object, after the
+// separator unless it is the first one
+void render_json_key(strbuf_t *out, const char *key, const char *indent, bool *first) {
+    if (!*first) strbuf_append_str(out, indent ? ",\n" : ", ");
+    if (indent) strbuf_append_str(out, indent);
+    json_append_string(out, key);
+    strbuf_append(out, ": ", 2);
+    *first = false;
+}
+
+// Function to append the --fields of one drive as a JSON object body. Fields
+// go on separate lines with indent, or on one line if indent is NULL.
+void render_json_drive(strbuf_t *out, const drive_table_t *table, int i, const char *indent, unsigned int fields) {
+    const drive_info_t *d = &table->info[i];
+    bool first = true;
+    if (d->path) {
+        render_json_key(out, "path", indent, &first);
+        json_append_string(out, d->path);
+    }
+    if (fields & FIELD_DEVICE) {
+        render_json_key(out, "device", indent, &first);
+        json_append_string(out, d->device);
+    }
+    if (fields & FIELD_MOUNT) {
+        render_json_key(out, "mount_point", indent, &first);
+        json_append_string(out, d->mount_point);
+        render_json_key(out, "mount_points", indent, &first);
+        strbuf_append(out, "[", 1);
+        json_append_string(out, d->mount_point);
+        for (int j = 0; j < d->bind_mount_count; j++) {
+            strbuf_append(out, ", ", 2);
+            json_append_string(out, d->bind_mounts[j]);
+        }
+        strbuf_append(out, "]", 1);
+    }
+    if (fields & FIELD_FILESYSTEM) {
+        render_json_key(out, "filesystem", indent, &first);
+        json_append_string(out, d->filesystem);
+    }
+    if (fields & FIELD_SIZE) {
+        render_json_key(out, "total_bytes", indent, &first);
+        json_append_uint(out, table->total_bytes[i]);
+    }
+    if (fields & FIELD_USED) {
+        render_json_key(out, "used_bytes", indent, &first);
+        json_append_uint(out, table->used_bytes[i]);
+    }
+    if (fields & FIELD_AVAILABLE) {
+        render_json_key(out, "available_bytes", indent, &first);
+        json_append_uint(out, table->available_bytes[i]);
+    }
+    if (fields & FIELD_USAGE) {
+        render_json_key(out, "usage_percent", indent, &first);
+        json_append_fixed(out, table->usage_percent[i], 1);
+    }
+    if (fields & FIELD_TYPE) {
+        render_json_key(out, "type", indent, &first);
+        json_append_string(out, d->drive_type);
+        render_json_key(out, "is_cloud", indent, &first);
+        strbuf_append_str(out, d->is_cloud_storage ? "true" : "false");
+        render_json_key(out, "cloud_service", indent, &first);
+        json_append_string(out, d->cloud_service_name);
+    }
+    if (fields & FIELD_UUID) {
+        render_json_key(out, "uuid", indent, &first);
+        json_append_string(out, d->uuid);
+    }
+    if (fields & FIELD_LABEL) {
+        render_json_key(out, "label", indent, &first);
+        json_append_string(out, d->label);
+    }
+    if (fields & FIELD_PARTUUID) {
+        render_json_key(out, "partuuid", indent, &first);
+        json_append_string(out, d->partuuid);
+    }
+    if (fields & FIELD_DISK_ID) {
+        render_json_key(out, "disk_id", indent, &first);
+        json_append_string(out, d->disk_id);
+    }
+    if (fields & FIELD_DISK_PATH) {
+        render_json_key(out, "disk_path", indent, &first);
+        json_append_string(out, d->disk_path);
+    }
+    if (fields & FIELD_OPTIONS) {
+        render_json_key(out, "mount_options", indent, &first);
+        json_append_string(out, d->mount_options);
+    }
+    if (fields & FIELD_INODES) {
+        render_json_key(out, "total_inodes", indent, &first);
+        json_append_uint(out, table->total_inodes[i]);
+        render_json_key(out, "used_inodes", indent, &first);
+        json_append_uint(out, table->used_inodes[i]);
+        render_json_key(out, "inode_usage", indent, &first);
+        json_append_fixed(out, table->inode_usage[i], 1);
+    }
+    if (fields & FIELD_SMART) {
+        render_json_key(out, "smart", indent, &first);
+        if (d->has_smart) {
+            strbuf_append_str(out, "{\"status\": ");
+            json_append_string(out, d->smart.status);
+            render_json_smart_value(out, "temperature", d->smart.temperature);
+            render_json_smart_value(out, "power_on_hours", d->smart.power_on_hours);
+            render_json_smart_value(out, "percentage_used", d->smart.percentage_used);
+            render_json_smart_value(out, "reallocated_sectors", d->smart.reallocated_sectors);
+            strbuf_append(out, "}", 1);
+        } else {
+            strbuf_append_str(out, "null");
+        }
+    }
+    if (fields & FIELD_STATE) {
+        render_json_key(out, "state", indent, &first);
+        strbuf_append_str(out, d->timed_out ? "\"timeout\"" : "\"ok\"");
+    }
+}
+
+// Function to print the drives as one JSON document. It is built in memory
+// and handed to the kernel with a single write().
+void print_json(const drive_table_t *table) {
+    int count = table->count;
+    // With --profile the drives move into an object next to "_meta"
+    const char *pad = opt_profile ? "  " : "";
+    const char *indent = opt_profile ? "      " : "    ";
+    profile_mark_t mark = profile_begin();
+    strbuf_t out = {0};
+    strbuf_append_str(&out, opt_profile ? "{\n  \"drives\": [\n" : "[\n");
+    for (int i = 0; i < count; i++) {
+        strbuf_append_str(&out, pad);
+        strbuf_append_str(&out, "  {\n");
+        render_json_drive(&out, table, (int)table->order[i], indent, opt_fields);
+        strbuf_append(&out, "\n", 1);
+        strbuf_append_str(&out, pad);
+        strbuf_append_str(&out, i < count - 1 ? "  },\n" : "  }\n");
+    }
+    if (opt_profile) {
+        strbuf_append_str(&out, "  ],\n");
+        profile_end(PROFILE_RENDER, mark);
+        render_json_profile(&out);
+        strbuf_append_str(&out, "}\n");
+    } else {
+        strbuf_append_str(&out, "]\n");
+    }
+    write_output(&out);
+    strbuf_free(&out);
+}
+
+// Helper: append one SMART value for render_binary_drive(), null if unknown
+void render_binary_smart_value(strbuf_t *out, const char *key, long long value)
+{
+    binary_append_string(out, key);
+    if (value == SMART_UNKNOWN)
+        binary_append_null(out);
+    else
+        binary_append_int(out, value);
+}
+
+// Function to append one drive as a CBOR or MessagePack map with the same
+// members as its JSON object. Byte and inode counts stay integers.
+void render_binary_drive(strbuf_t *out, const drive_table_t *table, int i, unsigned int fields) {
+    const drive_info_t *d = &table->info[i];
+    // Members per field, in field bit order; the map length comes first
+    static const int members[] = {1, 2, 1, 1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 3, 1, 1};
+    int count = d->path ? 1 : 0;
+    for (int f = 0; f < (int)(sizeof(members) / sizeof(members[0])); f++)
+        if (fields & (1u << f)) count += members[f];
+    binary_append_header(out, BINARY_MAP, (uint64_t)count);
+
+    if (d->path) {
+        binary_append_string(out, "path");
+        binary_append_string(out, d->path);
+    }
+    if (fields & FIELD_DEVICE) {
+        binary_append_string(out, "device");
+        binary_append_string(out, d->device);
+    }
+    if (fields & FIELD_MOUNT) {
+        binary_append_string(out, "mount_point");
+        binary_append_string(out, d->mount_point);
+        binary_append_string(out, "mount_points");
+        binary_append_header(out, BINARY_ARRAY, (uint64_t)d->bind_mount_count + 1);
+        binary_append_string(out, d->mount_point);
+        for (int j = 0; j < d->bind_mount_count; j++)
+            binary_append_string(out, d->bind_mounts[j]);
+    }
+    if (fields & FIELD_FILESYSTEM) {
+        binary_append_string(out, "filesystem");
+        binary_append_string(out, d->filesystem);
+    }
+    if (fields & FIELD_SIZE) {
+        binary_append_string(out, "total_bytes");
+        binary_append_header(out, BINARY_UINT, table->total_bytes[i]);
+    }
+    if (fields & FIELD_USED) {
+        binary_append_string(out, "used_bytes");
+        binary_append_header(out, BINARY_UINT, table->used_bytes[i]);
+    }
+    if (fields & FIELD_AVAILABLE) {
+        binary_append_string(out, "available_bytes");
+        binary_append_header(out, BINARY_UINT, table->available_bytes[i]);
+    }
+    if (fields & FIELD_USAGE) {
+        binary_append_string(out, "usage_percent");
+        binary_append_float(out, table->usage_percent[i]);
+    }
+    if (fields & FIELD_TYPE) {
+        binary_append_string(out, "type");
+        binary_append_string(out, d->drive_type);
+        binary_append_string(out, "is_cloud");
+        binary_append_bool(out, d->is_cloud_storage);
+        binary_append_string(out, "cloud_service");
+        binary_append_string(out, d->cloud_service_name);
+    }
+    if (fields & FIELD_UUID) {
+        binary_append_string(out, "uuid");
+        binary_append_string(out, d->uuid);
+    }
+    if (fields & FIELD_LABEL) {
+        binary_append_string(out, "label");
+        binary_append_string(out, d->label);
+    }
+    if (fields & FIELD_PARTUUID) {
+        binary_append_string(out, "partuuid");
+        binary_append_string(out, d->partuuid);
+    }
+    if (fields & FIELD_DISK_ID) {
+        binary_append_string(out, "disk_id");
+        binary_append_string(out, d->disk_id);
+    }
+    if (fields & FIELD_DISK_PATH) {
+        binary_append_string(out, "disk_path");
+        binary_append_string(out, d->disk_path);
+    }
+    if (fields & FIELD_OPTIONS) {
+        binary_append_string(out, "mount_options");
+        binary_append_string(out, d->mount_options);
+    }
+    if (fields & FIELD_INODES) {
+        binary_append_string(out, "total_inodes");
+        binary_append_header(out, BINARY_UINT, table->total_inodes[i]);
+        binary_append_string(out, "used_inodes");
+        binary_append_header(out, BINARY_UINT, table->used_inodes[i]);
+        binary_append_string(out, "inode_usage");
+        binary_append_float(out, table->inode_usage[i]);
+    }
+    if (fields & FIELD_SMART) {
+        binary_append_string(out, "smart");
+        if (d->has_smart) {
+            binary_append_header(out, BINARY_MAP, 5);
+            binary_append_string(out, "status");
+            binary_append_string(out, d->smart.status);
+            render_binary_smart_value(out, "temperature", d->smart.temperature);
+            render_binary_smart_value(out, "power_on_hours", d->smart.power_on_hours);
+            render_binary_smart_value(out, "percentage_used", d->smart.percentage_used);
+            render_binary_smart_value(out, "reallocated_sectors", d->smart.reallocated_sectors);
+        } else {
+            binary_append_null(out);
+        }
+    }
+    if (fields & FIELD_STATE) {
+        binary_append_string(out, "state");
+        binary_append_string(out, d->timed_out ? "timeout" : "ok");
+    }
+}
+
+// Function to print the drives as one CBOR or MessagePack array of maps,
+// the records of print_json() in a single write()
+void print_binary(const drive_table_t *table) {
+    binary_format = opt_format;
+    strbuf_t out = {0};
+    binary_append_header(&out, BINARY_ARRAY, (uint64_t)table->count);
+    for (int i = 0; i < table->count; i++)
+        render_binary_drive(&out, table, (int)table->order[i], opt_fields);
+    write_output(&out);
+    strbuf_free(&out);
+}
+
+// Helper: append s as a Prometheus label value, escaping '\\', '"' and
+// newlines
+void prometheus_append_label_value(strbuf_t *out, const char *s)
+{
+    strbuf_append(out, "\"", 1);
+    const char *start = s;
+    for (; *s; s++)
+    {
+        const char *escape = *s == '\\' ? "\\\\" : *s == '"' ? "\\\"" : *s == '\n' ? "\\n" : NULL;
+        if (!escape)
+            continue;
+        strbuf_append(out, start, (size_t)(s - start));
+        strbuf_append(out, escape, 2);
+        start = s + 1;
+    }
+    strbuf_append(out, start, (size_t)(s - start));
+    strbuf_append(out, "\"", 1);
+}
+
+// Helper: append the name and labels of a sample of drive i
+void render_prometheus_series(strbuf_t *out, const char *name, const drive_table_t *table, int i)
+{
+    const drive_info_t *d = &table->info[i];
+    strbuf_append_str(out, name);
+    strbuf_append_str(out, "{device=");
+    prometheus_append_label_value(out, d->device);
+    strbuf_append_str(out, ",mountpoint=");
+    prometheus_append_label_value(out, d->mount_point);
+    strbuf_append_str(out, ",fstype=");
+    prometheus_append_label_value(out, d->filesystem);
+    strbuf_append_str(out, ",uuid=");
+    prometheus_append_label_value(out, d->uuid);
+    if (d->path) {
+        // PATH arguments on the same filesystem would repeat the series
+        strbuf_append_str(out, ",path=");
+        prometheus_append_label_value(out, d->path);
+    }
+    strbuf_append(out, "} ", 2);
+}
+
+// Helper: append the HELP and TYPE lines of a metric family
+void render_prometheus_header(strbuf_t *out, const char *name, const char *type, const char *help)
+{
+    strbuf_append_str(out, "# HELP ");
+    strbuf_append_str(out, name);
+    strbuf_append(out, " ", 1);
+    strbuf_append_str(out, help);
+    strbuf_append_str(out, "\n# TYPE ");
+    strbuf_append_str(out, name);
+    strbuf_append(out, " ", 1);
+    strbuf_append_str(out, type);
+    strbuf_append(out, "\n", 1);
+}
+
+// Function to append a gauge with one sample per drive from a statvfs
+// column. Drives whose probe timed out have no figures and are left out.
+void render_prometheus_column(strbuf_t *out, const drive_table_t *table, const char *name, const char *help,
+                              const unsigned long long *values)
+{
+    render_prometheus_header(out, name, "gauge", help);
+    for (int n = 0; n < table->count; n++) {
+        int i = (int)table->order[n];
+        if (table->info[i].timed_out)
+            continue;
+        render_prometheus_series(out, name, table, i);
+        json_append_uint(out, values[i]);
+        strbuf_append(out, "\n", 1);
+    }
+}
+
+// Helper: which SMART value of a drive a gauge shows
+typedef enum { SMART_TEMPERATURE, SMART_POWER_ON_HOURS, SMART_PERCENTAGE_USED, SMART_REALLOCATED } smart_value_t;
+
+// Function to append a gauge of one SMART value for the drives that have it
+void render_prometheus_smart(strbuf_t *out, const drive_table_t *table, const char *name, const char *help,
+                             smart_value_t which)
+{
+    bool header = false;
+    for (int n = 0; n < table->count; n++) {
+        int i = (int)table->order[n];
+        const drive_info_t *d = &table->info[i];
+        if (!d->has_smart)
+            continue;
+        long long value = which == SMART_TEMPERATURE ? d->smart.temperature
+                        : which == SMART_POWER_ON_HOURS ? d->smart.power_on_hours
+                        : which == SMART_PERCENTAGE_USED ? d->smart.percentage_used
+                        : d->smart.reallocated_sectors;
+        if (value == SMART_UNKNOWN)
+            continue;
+        if (!header) {
+            render_prometheus_header(out, name, "gauge", help);
+            header = true;
+        }
+        render_prometheus_series(out, name, table, i);
+        json_append_int(out, value);
+        strbuf_append(out, "\n", 1);
+    }
+}
+
+// Function to append the probe latency histogram, in seconds
+void render_prometheus_latency(strbuf_t *out)
+{
+    const char *name = "drinfo_probe_duration_seconds";
+    render_prometheus_header(out, name, "histogram", "Time taken by statvfs() probes of mounted filesystems.");
+    long long cumulative = 0;
+    for (int b = 0; b < PROBE_LATENCY_BUCKET_COUNT; b++) {
+        cumulative += probe_latency.buckets[b];
+        strbuf_append_str(out, name);
+        char bound[MAX_FLOAT_LENGTH];
+        snprintf(bound, sizeof(bound), "%g", (double)probe_latency_bounds_us[b] / US_PER_SECOND);
+        strbuf_append_str(out, "_bucket{le=\"");
+        strbuf_append_str(out, bound);
+        strbuf_append_str(out, "\"} ");
+        json_append_int(out, cumulative);
+        strbuf_append(out, "\n", 1);
+    }
+    strbuf_append_str(out, name);
+    strbuf_append_str(out, "_bucket{le=\"+Inf\"} ");
+    json_append_int(out, probe_latency.count);
+    strbuf_append(out, "\n", 1);
+    strbuf_append_str(out, name);
+    strbuf_append_str(out, "_sum ");
+    json_append_fixed(out, (double)probe_latency.sum_us / US_PER_SECOND, 6);
+    strbuf_append(out, "\n", 1);
+    strbuf_append_str(out, name);
+    strbuf_append_str(out, "_count ");
+    json_append_int(out, probe_latency.count);
+    strbuf_append(out, "\n", 1);
+}
+
+// Function to print the drives in the Prometheus text exposition format.
+// Metric families follow --fields; labels are always device, mountpoint,
+// fstype and uuid.
+void print_prometheus(const drive_table_t *table) {
+    strbuf_t out = {0};
+    if (opt_fields & FIELD_SIZE)
+        render_prometheus_column(&out, table, "drinfo_filesystem_size_bytes", "Total size of the filesystem in bytes.",
+                                 table->total_bytes);
+    if (opt_fields & FIELD_USED)
+        render_prometheus_column(&out, table, "drinfo_filesystem_used_bytes", "Bytes in use on the filesystem.",
+                                 table->used_bytes);
+    if (opt_fields & FIELD_AVAILABLE)
+        render_prometheus_column(&out, table, "drinfo_filesystem_avail_bytes",
+                                 "Bytes available to unprivileged users.", table->available_bytes);
+    if (opt_fields & FIELD_INODES) {
+        render_prometheus_column(&out, table, "drinfo_filesystem_inodes_total", "Total number of inodes.",
+                                 table->total_inodes);
+        render_prometheus_column(&out, table, "drinfo_filesystem_inodes_used", "Number of inodes in use.",
+                                 table->used_inodes);
+    }
+    if (opt_fields & FIELD_STATE) {
+        const char *name = "drinfo_filesystem_probe_timeout";
+        render_prometheus_header(&out, name, "gauge", "1 if statvfs() did not answer in time, else 0.");
+        for (int n = 0; n < table->count; n++) {
+            int i = (int)table->order[n];
+            render_prometheus_series(&out, name, table, i);
+            strbuf_append_str(&out, table->info[i].timed_out ? "1\n" : "0\n");
+        }
+    }
+    if (opt_fields & FIELD_SMART) {
+        bool header = false;
+        for (int n = 0; n < table->count; n++) {
+            int i = (int)table->order[n];
+            const char *status = table->info[i].smart.status;
+            if (!table->info[i].has_smart || !status[0])
+                continue;
+            if (!header) {
+                render_prometheus_header(&out, "drinfo_smart_healthy", "gauge",
+                                         "1 if the SMART overall health check passed, else 0.");
+                header = true;
+            }
+            render_prometheus_series(&out, "drinfo_smart_healthy", table, i);
+            strbuf_append_str(&out, strcmp(status, "PASSED") == 0 ? "1\n" : "0\n");
+        }
+        render_prometheus_smart(&out, table, "drinfo_smart_temperature_celsius", "Disk temperature.",
+                                SMART_TEMPERATURE);
+        render_prometheus_smart(&out, table, "drinfo_smart_power_on_hours", "Hours the disk has been powered on.",
+                                SMART_POWER_ON_HOURS);
+        render_prometheus_smart(&out, table, "drinfo_smart_percentage_used", "Estimated wear of the disk in percent.",
+                                SMART_PERCENTAGE_USED);
+        render_prometheus_smart(&out, table, "drinfo_smart_reallocated_sectors", "Reallocated sector count.",
+                                SMART_REALLOCATED);
+    }
+    render_prometheus_latency(&out);
+    write_output(&out);
+    strbuf_free(&out);
+}
+
+// Function to print the drives in the --format chosen, other than text
+void print_document(const drive_table_t *table) {
+    if (opt_format == FORMAT_JSON)
+        print_json(table);
+    else if (opt_format == FORMAT_PROMETHEUS)
+        print_prometheus(table);
+    else
+        print_binary(table);
+}
+
+// Helper: take the next column of rows elements from the cursor and copy
+// the kept ones over from the old column
+void *place_column(char **cursor, const void *old, size_t kept, size_t rows, size_t element_size)
+{
+    void *column = *cursor;
+    if (kept)
+        memcpy(column, old, kept * element_size);
+    *cursor += rows * element_size;
+    return column;
+}
+
+// Function to lay out all columns of the table for capacity rows in one
+// allocation, keeping the rows already there
+bool resize_drive_table(drive_table_t *table, int capacity)
+{
+    size_t rows = (size_t)capacity;
+    size_t row_size = 5 * sizeof(unsigned long long) + 2 * sizeof(double) + sizeof(drive_info_t) + sizeof(uint32_t);
+    char *block = malloc(rows * row_size);
+    if (!block)
+    {
+        perror("malloc");
+        return false;
+    }
+
+    drive_table_t grown = *table;
+    size_t kept = (size_t)table->count;
+    char *cursor = block;
+    grown.total_bytes = place_column(&cursor, table->total_bytes, kept, rows, sizeof(unsigned long long));
+    grown.used_bytes = place_column(&cursor, table->used_bytes, kept, rows, sizeof(unsigned long long));
+    grown.available_bytes = place_column(&cursor, table->available_bytes, kept, rows, sizeof(unsigned long long));
+    grown.total_inodes = place_column(&cursor, table->total_inodes, kept, rows, sizeof(unsigned long long));
+    grown.used_inodes = place_column(&cursor, table->used_inodes, kept, rows, sizeof(unsigned long long));
+    grown.usage_percent = place_column(&cursor, table->usage_percent, kept, rows, sizeof(double));
+    grown.inode_usage = place_column(&cursor, table->inode_usage, kept, rows, sizeof(double));
+    grown.info = place_column(&cursor, table->info, kept, rows, sizeof(drive_info_t));
+    grown.order = place_column(&cursor, table->order, kept, rows, sizeof(uint32_t));
+
+    free(table->block);
+    grown.block = block;
+    grown.capacity = capacity;
+    *table = grown;
+    return true;
+}
+
+// Function to empty the table, keeping its memory for the next refresh
+void clear_drive_table(drive_table_t *table)
+{
+    table->count = 0;
+    arena_reset(&table->strings);
+}
+
+void free_drive_table(drive_table_t *table)
+{
+    free(table->block);
+    arena_free(&table->strings);
+    memset(table, 0, sizeof(*table));
+}
+
+// Helper: make room for one more row
+bool reserve_drive_row(drive_table_t *table)
+{
+    return table->count < table->capacity ||
+           resize_drive_table(table, table->capacity ? table->capacity * 2 : DRIVE_TABLE_INITIAL_CAPACITY);
+}
+
+// Function to turn a finished probe job into a new row of the drive table
+bool add_probed_drive(drive_table_t *table, const probe_job_t *job)
+{
+    if (!reserve_drive_row(table))
+        return false;
+
+    int i = table->count;
+    drive_info_t *drive = &table->info[i];
+    string_arena_t *strings = &table->strings;
+    const struct statvfs *fs_info = &job->fs_info;
+    bool timed_out = job->state == PROBE_TIMEOUT;
+
+    // Calculate sizes
+    unsigned long long total_bytes = 0, available_bytes = 0;
+    unsigned long long total_inodes = 0, used_inodes = 0;
+    double inode_usage = 0.0;
+    if (!timed_out)
+    {
+        total_bytes = (unsigned long long)fs_info->f_blocks * fs_info->f_frsize;
+        available_bytes = (unsigned long long)fs_info->f_bavail * fs_info->f_frsize;
+
+        // Inode-Infos
+        total_inodes = fs_info->f_files;
+        unsigned long long free_inodes = fs_info->f_favail;
+        used_inodes = total_inodes > 0 ? total_inodes - free_inodes : 0;
+        inode_usage = (total_inodes > 0) ? ((double)used_inodes / total_inodes) * 100.0 : 0.0;
+    }
+    table->total_bytes[i] = total_bytes;
+    table->available_bytes[i] = available_bytes;
+    table->used_bytes[i] = total_bytes - available_bytes;
+    table->usage_percent[i] = timed_out ? 0.0 : calculate_usage_percent(total_bytes, available_bytes);
+    table->total_inodes[i] = total_inodes;
+    table->used_inodes[i] = used_inodes;
+    table->inode_usage[i] = inode_usage;
+
+    memset(drive, 0, sizeof(*drive));
+    drive->mount_point = arena_strdup(strings, job->mount_point);
+    drive->filesystem = arena_intern(strings, job->filesystem);
+    drive->device = arena_strdup(strings, job->device);
+    drive->uuid = drive->label = drive->partuuid = drive->disk_id = drive->disk_path = "";
+    drive->mount_options = drive->cloud_service_name = "";
+    drive->timed_out = timed_out;
+
+    if (job->cloud_service_name)
+    {
+        drive->drive_type = "Network Drive";
+        drive->is_cloud_storage = true;
+        drive->cloud_service_name = job->cloud_service_name;
+        table->total_inodes[i] = (unsigned long long)fs_info->f_blocks;
+        table->used_inodes[i] = (unsigned long long)fs_info->f_files;
+        table->inode_usage[i] = fs_info->f_blocks ? (double)fs_info->f_files / (double)fs_info->f_blocks : 0.0;
+    }
+    else
+    {
+        // Determine drive type
+        if (is_physical_device(job->device))
+        {
+            drive->drive_type = "Local Drive";
+        }
+        else if (is_network_filesystem(job->filesystem) || is_network_device(job->device))
+        {
+            drive->drive_type = "Network Drive";
+        }
+        else
+        {
+            drive->drive_type = "Other Drive";
+        }
+
+        // UUID und Label ermitteln
+        const disk_ids_t *ids = NULL;
+        if (opt_fields & FIELDS_DISK_IDS)
+        {
+            profile_mark_t mark = profile_begin();
+            ids = find_disk_ids(job->device);
+            profile_end(PROFILE_DISK_IDS, mark);
+        }
+        if (ids)
+        {
+            drive->uuid = arena_strdup(strings, ids->uuid);
+            drive->label = arena_strdup(strings, ids->label);
+            drive->partuuid = arena_strdup(strings, ids->partuuid);
+            drive->disk_id = arena_strdup(strings, ids->disk_id);
+            drive->disk_path = arena_strdup(strings, ids->disk_path);
+        }
+        drive->mount_options = arena_intern(strings, job->mount_options);
+    }
+
+    // Other mount points of the same filesystem
+    if (job->bind_mount_count > 0)
+    {
+        drive->bind_mounts = arena_alloc(strings, (size_t)job->bind_mount_count * sizeof(char *));
+        for (int j = 0; drive->bind_mounts && j < job->bind_mount_count; j++)
+            drive->bind_mounts[drive->bind_mount_count++] = arena_strdup(strings, job->bind_mounts[j]);
+    }
+
+    table->order[i] = (uint32_t)i;
+    table->count++;
+    return true;
+}
+
+// Function to turn a comma separated --fields list into a field mask.
+// Returns NULL, or the name that is not a field. list is split in place.
+const char *parse_field_list(char *list, unsigned int *fields)
+{
+    *fields = 0;
+    char *name;
+    while ((name = strsep(&list, ",")) != NULL)
+    {
+        size_t f = 0;
+        size_t field_count = sizeof(field_names) / sizeof(field_names[0]);
+        while (f < field_count && strcmp(name, field_names[f].name) != 0)
+            f++;
+        if (f == field_count)
+            return name;
+        *fields |= field_names[f].mask;
+    }
+    return NULL;
+}
+
+// Function to decide whether a mount table entry is a drive worth reporting
+bool is_reportable_mount(const char *fsname, const char *mount_point, const char *fstype)
+{
+    // Skip special file systems
+    const int skip_count = sizeof(skip_filesystems) / sizeof(skip_filesystems[0]);
+    for (int i = 0; i < skip_count; i++)
+    {
+        if (strcmp(fstype, skip_filesystems[i]) == 0)
+            return false;
+    }
+
+    // Show physical drives and network drives
+    if (!is_physical_device(fsname) &&
+        !is_network_device(fsname) &&
+        !is_network_filesystem(fstype))
+    {
+        return false;
+    }
+
+    // Skip AppImages and temporary mounts
+    return !is_appimage_or_temp(fsname, mount_point);
+}
+
+// Names accepted on the left of a --where comparison
+const struct
+{
+    const char *name;
+    where_field_t field;
+} where_field_names[] = {
+    {"mount", WHERE_MOUNT}, {"device", WHERE_DEVICE}, {"type", WHERE_FSTYPE}, {"fs", WHERE_FSTYPE},
+    {"options", WHERE_OPTIONS}, {"state", WHERE_STATE}, {"size", WHERE_SIZE}, {"used", WHERE_USED},
+    {"avail", WHERE_AVAILABLE}, {"usage", WHERE_USAGE}, {"use", WHERE_USAGE}, {"inode_usage", WHERE_INODE_USAGE}};
+
+// Helper: whether a field is a number (bytes or percent)
+bool where_field_is_numeric(where_field_t field)
+{
+    return field >= WHERE_SIZE;
+}
+
+// Helper: append an instruction to the program
+where_node_t *where_add_node(where_program_t *program, int kind)
+{
+    if (program->count == program->capacity)
+    {
+        int capacity = program->capacity ? program->capacity * 2 : WHERE_INITIAL_CAPACITY;
+        where_node_t *grown = realloc(program->nodes, (size_t)capacity * sizeof(where_node_t));
+        where_result_t *stack = realloc(program->stack, (size_t)capacity * sizeof(where_result_t));
+        if (grown)
+            program->nodes = grown;
+        if (stack)
+            program->stack = stack;
+        if (!grown || !stack)
+            return NULL;
+        program->capacity = capacity;
+    }
+    where_node_t *node = &program->nodes[program->count++];
+    memset(node, 0, sizeof(*node));
+    node->kind = kind;
+    return node;
+}
+
+// Parser state of one --where expression
+typedef struct
+{
+    const char *cursor;
+    const char *error;
+    where_program_t *program;
+} where_parser_t;
+
+// Helper: skip blanks and report whether the input continues with token
+bool where_accept(where_parser_t *parser, const char *token)
+{
+    while (*parser->cursor == ' ' || *parser->cursor == '\t')
+        parser->cursor++;
+    size_t length = strlen(token);
+    if (strncmp(parser->cursor, token, length) != 0)
+        return false;
+    parser->cursor += length;
+    return true;
+}
+
+// Helper: read a comparison value, quoted or up to a blank, ')', && or ||
+bool where_read_value(where_parser_t *parser, char *value, size_t size)
+{
+    while (*parser->cursor == ' ' || *parser->cursor == '\t')
+        parser->cursor++;
+    const char *start = parser->cursor;
+    size_t length;
+    if (*start == '"' || *start == '\'')
+    {
+        const char *end = strchr(start + 1, *start);
+        if (!end)
+        {
+            parser->error = "unterminated quote";
+            return false;
+        }
+        start++;
+        length = (size_t)(end - start);
+        parser->cursor = end + 1;
+    }
+    else
+    {
+        const char *end = start;
+        while (*end && *end != ' ' && *end != '\t' && *end != ')' && strncmp(end, "&&", 2) != 0 &&
+               strncmp(end, "||", 2) != 0)
+            end++;
+        length = (size_t)(end - start);
+        parser->cursor = end;
+        if (length == 0)
+        {
+            parser->error = "missing value";
+            return false;
+        }
+    }
+    if (length >= size)
+    {
+        parser->error = "value too long";
+        return false;
+    }
+    memcpy(value, start, length);
+    value[length] = '\0';
+    return true;
+}
+
+// Helper: parse a number with an optional K, M, G or T (powers of 1024)
+bool where_parse_number(const char *text, double *number)
+{
+    char *end;
+    errno = 0;
+    *number = strtod(text, &end);
+    if (errno != 0 || end == text)
+        return false;
+    const char *units = "KMGT";
+    const char *unit = *end ? strchr(units, *end) : NULL;
+    if (unit)
+    {
+        for (const char *u = units; u <= unit; u++)
+            *number *= 1024;
+        end++;
+    }
+    return *end == '\0';
+}
+
+// Function to compile one comparison: FIELD OP VALUE
+bool where_parse_comparison(where_parser_t *parser)
+{
+    while (*parser->cursor == ' ' || *parser->cursor == '\t')
+        parser->cursor++;
+    char name[MAX_WHERE_FIELD_LENGTH];
+    size_t length = 0;
+    while ((parser->cursor[length] >= 'a' && parser->cursor[length] <= 'z') || parser->cursor[length] == '_')
+        length++;
+    size_t f = 0;
+    size_t field_count = sizeof(where_field_names) / sizeof(where_field_names[0]);
+    if (length > 0 && length < sizeof(name))
+    {
+        memcpy(name, parser->cursor, length);
+        name[length] = '\0';
+        while (f < field_count && strcmp(name, where_field_names[f].name) != 0)
+            f++;
+    }
+    if (!*parser->cursor)
+    {
+        parser->error = "expected an expression at end of input";
+        return false;
+    }
+    if (length == 0 || length >= sizeof(name) || f == field_count)
+    {
+        parser->error = "unknown field";
+        return false;
+    }
+    parser->cursor += length;
+
+    // Longer operators first, so <= is not read as <
+    static const struct
+    {
+        const char *token;
+        where_op_t op;
+    } ops[] = {{"==", WHERE_EQ}, {"!=", WHERE_NE}, {"=~", WHERE_MATCH}, {"!~", WHERE_NO_MATCH},
+               {"<=", WHERE_LE}, {">=", WHERE_GE}, {"<", WHERE_LT},     {">", WHERE_GT}};
+    size_t o = 0;
+    while (o < sizeof(ops) / sizeof(ops[0]) && !where_accept(parser, ops[o].token))
+        o++;
+    if (o == sizeof(ops) / sizeof(ops[0]))
+    {
+        parser->error = "expected ==, !=, =~, !~, <, <=, > or >=";
+        return false;
+    }
+
+    char value[MAX_WHERE_VALUE_LENGTH];
+    if (!where_read_value(parser, value, sizeof(value)))
+        return false;
+
+    where_node_t *node = where_add_node(parser->program, WHERE_COMPARE);
+    if (!node)
+    {
+        parser->error = "out of memory";
+        return false;
+    }
+    node->field = where_field_names[f].field;
+    node->op = ops[o].op;
+    bool numeric = where_field_is_numeric(node->field);
+    if (numeric && (node->op == WHERE_MATCH || node->op == WHERE_NO_MATCH))
+    {
+        parser->error = "=~ and !~ need a text field";
+        return false;
+    }
+    if (!numeric && node->op >= WHERE_LT)
+    {
+        parser->error = "<, <=, > and >= need a numeric field";
+        return false;
+    }
+    if (numeric && !where_parse_number(value, &node->number))
+    {
+        parser->error = "invalid number";
+        return false;
+    }
+    if (node->op == WHERE_MATCH || node->op == WHERE_NO_MATCH)
+    {
+        if (regcomp(&node->regex, value, REG_EXTENDED | REG_NOSUB) != 0)
+        {
+            // Leave nothing to regfree() for this node
+            node->op = WHERE_EQ;
+            parser->error = "invalid regular expression";
+            return false;
+        }
+    }
+    node->text = strdup(value);
+    if (!node->text)
+    {
+        parser->error = "out of memory";
+        return false;
+    }
+    if (numeric || node->field == WHERE_STATE)
+        parser->program->needs_probe = true;
+    return true;
+}
+
+bool where_parse_or(where_parser_t *parser);
+
+// Function to compile a negation, a parenthesized expression or a comparison
+bool where_parse_unary(where_parser_t *parser)
+{
+    if (where_accept(parser, "!"))
+    {
+        if (!where_parse_unary(parser))
+            return false;
+        return where_add_node(parser->program, WHERE_NOT) != NULL;
+    }
+    if (where_accept(parser, "("))
+    {
+        if (!where_parse_or(parser))
+            return false;
+        if (!where_accept(parser, ")"))
+        {
+            parser->error = "expected )";
+            return false;
+        }
+        return true;
+    }
+    return where_parse_comparison(parser);
+}
+
+// Function to compile terms joined by &&
+bool where_parse_and(where_parser_t *parser)
+{
+    if (!where_parse_unary(parser))
+        return false;
+    while (where_accept(parser, "&&"))
+    {
+        if (!where_parse_unary(parser) || !where_add_node(parser->program, WHERE_AND))
+            return false;
+    }
+    return true;
+}
+
+// Function to compile terms joined by ||, the lowest precedence
+bool where_parse_or(where_parser_t *parser)
+{
+    if (!where_parse_and(parser))
+        return false;
+    while (where_accept(parser, "||"))
+    {
+        if (!where_parse_and(parser) || !where_add_node(parser->program, WHERE_OR))
+            return false;
+    }
+    return true;
+}
+
+// Function to compile a --where expression and AND it to the program.
+// Returns NULL on success, or an error message with *error_at set.
+const char *where_compile(where_program_t *program, const char *expression, const char **error_at)
+{
+    bool combine = program->count > 0;
+    where_parser_t parser = {expression, NULL, program};
+    if (!where_parse_or(&parser) && !parser.error)
+        parser.error = "out of memory";
+    where_accept(&parser, "");
+    if (!parser.error && *parser.cursor)
+        parser.error = "unexpected input";
+    if (!parser.error && combine && !where_add_node(program, WHERE_AND))
+        parser.error = "out of memory";
+    *error_at = parser.cursor;
+    return parser.error;
+}
+
+// Function to add "type != X" for each type of a comma separated list
+bool where_exclude_types(where_program_t *program, const char *list)
+{
+    char *types = strdup(list);
+    if (!types)
+        return false;
+    char *rest = types;
+    char *type;
+    bool ok = true;
+    while (ok && (type = strsep(&rest, ",")) != NULL)
+    {
+        if (!*type)
+            continue;
+        bool combine = program->count > 0;
+        where_node_t *node = where_add_node(program, WHERE_COMPARE);
+        if (!node)
+        {
+            ok = false;
+            break;
+        }
+        node->field = WHERE_FSTYPE;
+        node->op = WHERE_NE;
+        node->text = strdup(type);
+        ok = node->text && (!combine || where_add_node(program, WHERE_AND));
+    }
+    free(types);
+    return ok;
+}
+
+// Function to evaluate one comparison; probe results are unknown until probed
+where_result_t where_compare(const where_node_t *node, const where_subject_t *subject)
+{
+    if (where_field_is_numeric(node->field) || node->field == WHERE_STATE)
+    {
+        if (!subject->probed)
+            return WHERE_UNKNOWN;
+        if (node->field != WHERE_STATE && subject->timed_out)
+            return WHERE_UNKNOWN;
+    }
+
+    if (where_field_is_numeric(node->field))
+    {
+        double value = node->field == WHERE_SIZE        ? subject->size
+                       : node->field == WHERE_USED      ? subject->used
+                       : node->field == WHERE_AVAILABLE ? subject->available
+                       : node->field == WHERE_USAGE     ? subject->usage
+                                                        : subject->inode_usage;
+        switch (node->op)
+        {
+            case WHERE_EQ: return value == node->number;
+            case WHERE_NE: return value != node->number;
+            case WHERE_LT: return value < node->number;
+            case WHERE_LE: return value <= node->number;
+            case WHERE_GT: return value > node->number;
+            case WHERE_GE: return value >= node->number;
+            default: return WHERE_FALSE;
+        }
+    }
+
+    const char *value = node->field == WHERE_MOUNT    ? subject->mount_point
+                        : node->field == WHERE_DEVICE ? subject->device
+                        : node->field == WHERE_FSTYPE ? subject->fstype
+                        : node->field == WHERE_STATE  ? (subject->timed_out ? "timeout" : "ok")
+                                                      : subject->options;
+    switch (node->op)
+    {
+        case WHERE_EQ: return strcmp(value, node->text) == 0;
+        case WHERE_NE: return strcmp(value, node->text) != 0;
+        case WHERE_MATCH: return regexec(&node->regex, value, 0, NULL, 0) == 0;
+        case WHERE_NO_MATCH: return regexec(&node->regex, value, 0, NULL, 0) != 0;
+        default: return WHERE_FALSE;
+    }
+}
+
+// Function to run the program on a subject with Kleene logic, so a mount
+// can be ruled out before probing whenever the known fields decide it
+where_result_t where_evaluate(const where_program_t *program, const where_subject_t *subject)
+{
+    int depth = 0;
+    where_result_t *stack = program->stack;
+    for (int i = 0; i < program->count; i++)
+    {
+        const where_node_t *node = &program->nodes[i];
+        if (node->kind == WHERE_COMPARE)
+        {
+            stack[depth++] = where_compare(node, subject);
+        }
+        else if (node->kind == WHERE_NOT)
+        {
+            if (stack[depth - 1] != WHERE_UNKNOWN)
+                stack[depth - 1] = stack[depth - 1] == WHERE_TRUE ? WHERE_FALSE : WHERE_TRUE;
+        }
+        else
+        {
+            where_result_t b = stack[--depth];
+            where_result_t a = stack[depth - 1];
+            where_result_t dominant = node->kind == WHERE_AND ? WHERE_FALSE : WHERE_TRUE;
+            if (a == dominant || b == dominant)
+                stack[depth - 1] = dominant;
+            else if (a == WHERE_UNKNOWN || b == WHERE_UNKNOWN)
+                stack[depth - 1] = WHERE_UNKNOWN;
+            else
+                stack[depth - 1] = a;
+        }
+    }
+    return depth ? stack[0] : WHERE_TRUE;
+}
+
+// Function to decide before probing whether a mount may still match
+bool where_accepts_job(const probe_job_t *job)
+{
+    if (where_program.count == 0)
+        return true;
+    where_subject_t subject = {job->mount_point, job->device, job->filesystem, job->mount_options,
+                               false, false, 0, 0, 0, 0, 0};
+    return where_evaluate(&where_program, &subject) != WHERE_FALSE;
+}
+
+// Function to check a drive against the whole --where program, including
+// the mount table fields that are normally checked before probing
+bool where_matches_drive(const where_program_t *program, const drive_table_t *table, int i)
+{
+    if (program->count == 0)
+        return true;
+    const drive_info_t *drive = &table->info[i];
+    where_subject_t subject = {drive->mount_point,
+                               drive->device,
+                               drive->filesystem,
+                               drive->mount_options,
+                               true,
+                               drive->timed_out,
+                               (double)table->total_bytes[i],
+                               (double)table->used_bytes[i],
+                               (double)table->available_bytes[i],
+                               table->usage_percent[i],
+                               table->inode_usage[i]};
+    return where_evaluate(program, &subject) == WHERE_TRUE;
+}
+
+// Function to decide after probing whether a drive matches
+bool where_accepts_drive(const drive_table_t *table, int i)
+{
+    return !where_program.needs_probe || where_matches_drive(&where_program, table, i);
+}
+
+// Function to free the compiled filters
+void free_where_program(where_program_t *program)
+{
+    for (int i = 0; i < program->count; i++)
+    {
+        if (program->nodes[i].op == WHERE_MATCH || program->nodes[i].op == WHERE_NO_MATCH)
+            regfree(&program->nodes[i].regex);
+        free(program->nodes[i].text);
+    }
+    free(program->nodes);
+    free(program->stack);
+    memset(program, 0, sizeof(*program));
+}
+
+// Helper: cut the next space separated field off *cursor
+char *next_mount_field(char **cursor)
+{
+    char *field = *cursor;
+    char *end = strchr(field, ' ');
+    if (end)
+    {
+        *end = '\0';
+        *cursor = end + 1;
+    }
+    else
+    {
+        *cursor = field + strlen(field);
+    }
+    return field;
+}
+
+// Helper: decode the octal escapes (\040 for a space etc.) the kernel uses
+// in mount table fields, in place
+void unescape_mount_field(char *field)
+{
+    char *in = strchr(field, '\\');
+    if (!in)
+        return;
+
+    char *out = in;
+    while (*in)
+    {
+        if (in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' &&
+            in[3] >= '0' && in[3] <= '7')
+        {
+            *out++ = (char)(((in[1] - '0') << 6) | ((in[2] - '0') << 3) | (in[3] - '0'));
+            in += 4;
+        }
+        else
+        {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
+
+// Function to split one NUL-terminated mountinfo line into its fields:
+// "36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw,errors=continue"
+bool parse_mountinfo_line(char *line, mount_entry_t *entry)
+{
+    char *cursor = line;
+    char *end;
+
+    entry->mount_id = (int)strtol(next_mount_field(&cursor), &end, 10);
+    if (*end != '\0')
+        return false;
+    entry->parent_id = (int)strtol(next_mount_field(&cursor), &end, 10);
+    if (*end != '\0')
+        return false;
+    char *device_number = next_mount_field(&cursor);
+    entry->major = (unsigned int)strtoul(device_number, &end, 10);
+    if (*end != ':')
+        return false;
+    entry->minor = (unsigned int)strtoul(end + 1, &end, 10);
+    if (*end != '\0')
+        return false;
+
+    entry->root = next_mount_field(&cursor);
+    entry->mount_point = next_mount_field(&cursor);
+    entry->mount_options = next_mount_field(&cursor);
+
+    // Zero or more optional fields, terminated by a lone "-"
+    if (cursor[0] == '-' && cursor[1] == ' ')
+    {
+        entry->optional_fields = cursor;
+        *cursor = '\0';
+        cursor += 2;
+    }
+    else
+    {
+        char *separator = strstr(cursor, " - ");
+        if (!separator)
+            return false;
+        *separator = '\0';
+        entry->optional_fields = cursor;
+        cursor = separator + 3;
+    }
+
+    entry->fstype = next_mount_field(&cursor);
+    entry->source = next_mount_field(&cursor);
+    entry->super_options = next_mount_field(&cursor);
+
+    unescape_mount_field(entry->root);
+    unescape_mount_field(entry->mount_point);
+    unescape_mount_field(entry->source);
+    return true;
+}
+
+// Function to read a mountinfo file with a few large reads and index its
+// lines without copying them. Returns false if the file cannot be read.
+bool load_mountinfo(const char *path, mount_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    size_t capacity = MOUNT_TABLE_READ_SIZE;
+    table->buffer = malloc(capacity + 1);
+    while (table->buffer)
+    {
+        if (table->length == capacity)
+        {
+            char *grown = realloc(table->buffer, capacity * 2 + 1);
+            if (!grown)
+                break;
+            table->buffer = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(fd, table->buffer + table->length, capacity - table->length);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            if (got < 0)
+                table->length = 0;
+            break;
+        }
+        table->length += (size_t)got;
+    }
+    close(fd);
+    if (!table->buffer || table->length == 0)
+    {
+        free(table->buffer);
+        table->buffer = NULL;
+        return false;
+    }
+    table->buffer[table->length] = '\0';
+
+    // One entry per line; size the array exactly before tokenizing
+    int lines = 0;
+    for (const char *p = table->buffer; (p = memchr(p, '\n', table->buffer + table->length - p)); p++)
+        lines++;
+    table->entries = malloc((size_t)(lines + 1) * sizeof(mount_entry_t));
+    if (!table->entries)
+    {
+        free(table->buffer);
+        table->buffer = NULL;
+        return false;
+    }
+
+    char *line = table->buffer;
+    while (*line)
+    {
+        char *newline = strchr(line, '\n');
+        char *next = newline ? newline + 1 : line + strlen(line);
+        if (newline)
+            *newline = '\0';
+        mount_entry_t *entry = &table->entries[table->count];
+        if (parse_mountinfo_line(line, entry))
+        {
+            entry->unique_id = (uint64_t)entry->mount_id;
+            table->count++;
+        }
+        line = next;
+    }
+    return true;
+}
+
+void free_mount_table(mount_table_t *table)
+{
+    free(table->entries);
+    free(table->buffer);
+    memset(table, 0, sizeof(*table));
+}
+
+// Helper: order mount IDs for bsearch()
+int compare_mount_ids(const void *a, const void *b)
+{
+    uint64_t id_a = *(const uint64_t *)a;
+    uint64_t id_b = *(const uint64_t *)b;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+// Function to list the unique IDs of all mounts with listmount(), in
+// ascending order. Returns the count, or -1 (errno set) if not supported.
+int list_mount_ids(uint64_t **ids)
+{
+    *ids = NULL;
+    int count = 0;
+    int capacity = 0;
+    mount_id_request_t request = {MOUNT_ID_REQUEST_SIZE, 0, LIST_MOUNT_ROOT, 0};
+
+    for (;;)
+    {
+        if (capacity - count < LIST_MOUNT_BATCH)
+        {
+            uint64_t *grown = realloc(*ids, (size_t)(capacity + LIST_MOUNT_BATCH) * sizeof(uint64_t));
+            if (!grown)
+            {
+                free(*ids);
+                *ids = NULL;
+                errno = ENOMEM;
+                return -1;
+            }
+            *ids = grown;
+            capacity += LIST_MOUNT_BATCH;
+        }
+
+        // Continue after the last ID of the previous batch
+        long got = syscall(SYS_listmount, &request, *ids + count, (size_t)LIST_MOUNT_BATCH, 0);
+        if (got < 0)
+        {
+            free(*ids);
+            *ids = NULL;
+            return -1;
+        }
+        count += (int)got;
+        if (got < LIST_MOUNT_BATCH)
+            break;
+        request.param = (*ids)[count - 1];
+    }
+    return count;
+}
+
+// Helper: call statmount() for one mount, growing the buffer as needed.
+// Returns false (errno set) if the mount is gone or the call failed.
+bool statmount_one(uint64_t id, statmount_result_t **result, size_t *size)
+{
+    mount_id_request_t request = {MOUNT_ID_REQUEST_SIZE, 0, id, STATMOUNT_WANTED};
+    for (;;)
+    {
+        if (syscall(SYS_statmount, &request, *result, *size, 0) == 0)
+            return true;
+        if (errno != EOVERFLOW)
+            return false;
+        statmount_result_t *grown = realloc(*result, *size * 2);
+        if (!grown)
+            return false;
+        *result = grown;
+        *size *= 2;
+    }
+}
+
+// Helper: append a NUL-terminated field to the table text and return its offset
+size_t add_mount_string(strbuf_t *text, const char *field)
+{
+    size_t offset = text->length;
+    strbuf_append(text, field, strlen(field) + 1);
+    return offset;
+}
+
+// Function to read the mount table with listmount()/statmount(). With ids
+// (sorted) only those mounts are looked up. The entries are laid out like
+// the procfs ones, so callers cannot tell the backends apart. Returns false
+// with errno ENOSYS if the kernel lacks the syscalls or the fields we need.
+bool load_statmount(mount_table_t *table, const uint64_t *ids, int id_count)
+{
+    memset(table, 0, sizeof(*table));
+
+    uint64_t *all_ids = NULL;
+    if (!ids)
+    {
+        id_count = list_mount_ids(&all_ids);
+        if (id_count < 0)
+            return false;
+        ids = all_ids;
+    }
+
+    size_t result_size = STATMOUNT_BUFFER_SIZE;
+    statmount_result_t *result = malloc(result_size);
+    table->entries = malloc((size_t)(id_count + 1) * sizeof(mount_entry_t));
+
+    // Entries hold offsets into the text while it may still move
+    strbuf_t text = {0};
+    strbuf_t options = {0};
+    bool ok = result && table->entries;
+    for (int i = 0; ok && i < id_count; i++)
+    {
+        if (!statmount_one(ids[i], &result, &result_size))
+        {
+            if (errno == ENOENT) // Unmounted since it was listed
+                continue;
+            ok = false;
+            break;
+        }
+        if ((result->mask & (STATMOUNT_SB_SOURCE | STATMOUNT_MNT_POINT)) !=
+            (STATMOUNT_SB_SOURCE | STATMOUNT_MNT_POINT))
+        {
+            errno = ENOSYS; // Before Linux 6.13 there is no mount source
+            ok = false;
+            break;
+        }
+
+        mount_entry_t *entry = &table->entries[table->count++];
+        entry->unique_id = result->mnt_id;
+        entry->mount_id = (int)result->mnt_id_old;
+        entry->parent_id = (int)result->mnt_parent_id_old;
+        entry->major = result->sb_dev_major;
+        entry->minor = result->sb_dev_minor;
+        entry->root = (char *)add_mount_string(&text, result->str + result->mnt_root);
+        entry->mount_point = (char *)add_mount_string(&text, result->str + result->mnt_point);
+        entry->source = (char *)add_mount_string(&text, result->str + result->sb_source);
+
+        // Subtypes are part of the type in mountinfo, e.g. fuse.sshfs
+        strbuf_reset(&options);
+        strbuf_append_str(&options, result->str + result->fs_type);
+        if ((result->mask & STATMOUNT_FS_SUBTYPE) && result->str[result->fs_subtype])
+            strbuf_printf(&options, ".%s", result->str + result->fs_subtype);
+        entry->fstype = (char *)add_mount_string(&text, options.data);
+
+        // Per-mount options, in the order the kernel prints them
+        uint64_t attr = result->mnt_attr;
+        strbuf_reset(&options);
+        strbuf_append_str(&options, attr & MOUNT_ATTR_RDONLY_FLAG ? "ro" : "rw");
+        if (attr & MOUNT_ATTR_NOSUID_FLAG)
+            strbuf_append_str(&options, ",nosuid");
+        if (attr & MOUNT_ATTR_NODEV_FLAG)
+            strbuf_append_str(&options, ",nodev");
+        if (attr & MOUNT_ATTR_NOEXEC_FLAG)
+            strbuf_append_str(&options, ",noexec");
+        if ((attr & MOUNT_ATTR_ATIME_MASK) == MOUNT_ATTR_NOATIME_FLAG)
+            strbuf_append_str(&options, ",noatime");
+        if (attr & MOUNT_ATTR_NODIRATIME_FLAG)
+            strbuf_append_str(&options, ",nodiratime");
+        if ((attr & MOUNT_ATTR_ATIME_MASK) == 0)
+            strbuf_append_str(&options, ",relatime");
+        if (attr & MOUNT_ATTR_NOSYMFOLLOW_FLAG)
+            strbuf_append_str(&options, ",nosymfollow");
+        entry->mount_options = (char *)add_mount_string(&text, options.data);
+
+        // Propagation tags
+        strbuf_reset(&options);
+        if (result->mnt_propagation & PROPAGATION_SHARED)
+            strbuf_printf(&options, " shared:%llu", (unsigned long long)result->mnt_peer_group);
+        if (result->mnt_propagation & PROPAGATION_SLAVE)
+        {
+            strbuf_printf(&options, " master:%llu", (unsigned long long)result->mnt_master);
+            if (result->propagate_from && result->propagate_from != result->mnt_master)
+                strbuf_printf(&options, " propagate_from:%llu", (unsigned long long)result->propagate_from);
+        }
+        if (result->mnt_propagation & PROPAGATION_UNBINDABLE)
+            strbuf_append_str(&options, " unbindable");
+        entry->optional_fields = (char *)add_mount_string(&text, options.length ? options.data + 1 : "");
+
+        // Superblock options
+        strbuf_reset(&options);
+        strbuf_append_str(&options, result->sb_flags & SB_RDONLY_FLAG ? "ro" : "rw");
+        if (result->sb_flags & SB_SYNCHRONOUS_FLAG)
+            strbuf_append_str(&options, ",sync");
+        if (result->sb_flags & SB_DIRSYNC_FLAG)
+            strbuf_append_str(&options, ",dirsync");
+        if (result->sb_flags & SB_LAZYTIME_FLAG)
+            strbuf_append_str(&options, ",lazytime");
+        if ((result->mask & STATMOUNT_MNT_OPTS) && result->str[result->mnt_opts])
+        {
+            const char *fs_options = result->str + result->mnt_opts;
+            strbuf_printf(&options, ",%s", fs_options[0] == ',' ? fs_options + 1 : fs_options);
+        }
+        entry->super_options = (char *)add_mount_string(&text, options.data);
+    }
+
+    free(result);
+    free(all_ids);
+    strbuf_free(&options);
+    if (!ok || text.failed)
+    {
+        int saved_errno = ok ? ENOMEM : errno;
+        strbuf_free(&text);
+        free(table->entries);
+        memset(table, 0, sizeof(*table));
+        errno = saved_errno;
+        return false;
+    }
+
+    // The text is final now; turn the offsets into pointers
+    table->buffer = text.data;
+    table->length = text.length;
+    for (int i = 0; i < table->count; i++)
+    {
+        mount_entry_t *entry = &table->entries[i];
+        entry->root = table->buffer + (size_t)entry->root;
+        entry->mount_point = table->buffer + (size_t)entry->mount_point;
+        entry->mount_options = table->buffer + (size_t)entry->mount_options;
+        entry->optional_fields = table->buffer + (size_t)entry->optional_fields;
+        entry->fstype = table->buffer + (size_t)entry->fstype;
+        entry->source = table->buffer + (size_t)entry->source;
+        entry->super_options = table->buffer + (size_t)entry->super_options;
+        unescape_mount_field(entry->super_options);
+    }
+    return true;
+}
+
+// Function to read the mount table with the best available backend. With
+// ids (sorted) only those mounts are returned: statmount() IDs, or mountinfo
+// IDs when the procfs backend is forced. Parsing mountinfo is cheaper than a
+// statmount() call per mount, so statmount() is used by default only when
+// a few mounts are wanted; the others are then not looked up at all.
+bool read_mount_table(mount_table_t *table, const uint64_t *ids, int id_count)
+{
+    // The syscalls only know the mounts of our own namespace, not a root's
+    if (!system_root[0] &&
+        (mount_backend == MOUNT_BACKEND_STATMOUNT || (mount_backend == MOUNT_BACKEND_AUTO && ids)))
+    {
+        if (load_statmount(table, ids, id_count))
+            return true;
+        if (mount_backend == MOUNT_BACKEND_STATMOUNT || (errno != ENOSYS && errno != EPERM))
+            return false;
+        // Remember, so we only try once; statmount() IDs mean nothing to procfs
+        mount_backend = MOUNT_BACKEND_PROCFS;
+        errno = ENOSYS;
+        return false;
+    }
+
+    char rooted[MAX_ROOTED_PATH_LENGTH];
+    if (!load_mountinfo(mount_table_path(rooted, sizeof(rooted)), table))
+        return false;
+    if (ids)
+    {
+        int kept = 0;
+        for (int i = 0; i < table->count; i++)
+        {
+            if (bsearch(&table->entries[i].unique_id, ids, (size_t)id_count, sizeof(uint64_t),
+                        compare_mount_ids))
+                table->entries[kept++] = table->entries[i];
+        }
+        table->count = kept;
+    }
+    return true;
+}
+
+// Helper: fill in a probe job for a mount table entry
+void fill_mount_job(probe_job_t *job, const mount_entry_t *entry)
+{
+    snprintf(job->mount_point, sizeof(job->mount_point), "%s", entry->mount_point);
+    snprintf(job->device, sizeof(job->device), "%s", entry->source);
+    snprintf(job->filesystem, sizeof(job->filesystem), "%s", entry->fstype);
+
+    // Show the options like /proc/mounts does: per-mount options followed
+    // by the superblock options, without repeating rw/ro
+    const char *super_options = entry->super_options;
+    if (strncmp(super_options, "rw", 2) == 0 || strncmp(super_options, "ro", 2) == 0)
+    {
+        if (super_options[2] == ',')
+            super_options += 3;
+        else if (super_options[2] == '\0')
+            super_options += 2;
+    }
+    if (*super_options)
+        snprintf(job->mount_options, sizeof(job->mount_options), "%s,%s", entry->mount_options,
+                 super_options);
+    else
+        snprintf(job->mount_options, sizeof(job->mount_options), "%s", entry->mount_options);
+    job->mount_id = entry->unique_id;
+    job->dev = makedev(entry->major, entry->minor);
+    job->fs_root = strcmp(entry->root, "/") == 0;
+    job->isolated = should_isolate(job->device, job->filesystem);
+}
+
+// Helper: turn the reportable entries of a mount table into probe jobs
+void add_mount_table_jobs(const mount_table_t *table, probe_job_t **jobs, int *job_count, int *job_capacity)
+{
+    for (int i = 0; i < table->count; i++)
+    {
+        const mount_entry_t *entry = &table->entries[i];
+        if (!is_reportable_mount(entry->source, entry->mount_point, entry->fstype))
+            continue;
+
+        probe_job_t *job = add_probe_job(jobs, job_count, job_capacity);
+        if (!job)
+            break;
+        fill_mount_job(job, entry);
+        if (!where_accepts_job(job))
+            (*job_count)--;
+    }
+}
+
+// Helper: add the GVFS cloud storage mounts of the current user
+void add_cloud_storage_jobs(probe_job_t **jobs, int *job_count, int *job_capacity)
+{
+    char gvfs_path[MAX_GVFS_PATH_LENGTH], rooted[MAX_ROOTED_PATH_LENGTH];
+    snprintf(gvfs_path, sizeof(gvfs_path), GVFS_BASE_PATH, getuid());
+    if (is_cloud_storage_directory(rooted_path(gvfs_path, rooted, sizeof(rooted))))
+    {
+        int first = *job_count;
+        collect_cloud_storage_jobs(gvfs_path, jobs, job_count, job_capacity);
+        int kept = first;
+        for (int i = first; i < *job_count; i++)
+        {
+            if (where_accepts_job(&(*jobs)[i]))
+                (*jobs)[kept++] = (*jobs)[i];
+        }
+        *job_count = kept;
+    }
+}
+
+// Function to parse the mount table (plus GVFS cloud storage if asked) into
+// a list of mounts to probe. Returns false if the mount table cannot be read.
+bool collect_mount_jobs(probe_job_t **jobs, int *job_count, bool include_cloud)
+{
+    *jobs = NULL;
+    *job_count = 0;
+    int job_capacity = 0;
+
+    // Read the mount table
+    mount_table_t table;
+    profile_mark_t mark = profile_begin();
+    if (!read_mount_table(&table, NULL, 0))
+    {
+        perror("Error reading mount table");
+        return false;
+    }
+    profile_end(PROFILE_PARSE, mark);
+    mark = profile_begin();
+    add_mount_table_jobs(&table, jobs, job_count, &job_capacity);
+    free_mount_table(&table);
+    profile_end(PROFILE_FILTER, mark);
+
+    // Check for GVFS-based cloud storage
+    if (include_cloud)
+    {
+        mark = profile_begin();
+        add_cloud_storage_jobs(jobs, job_count, &job_capacity);
+        profile_end(PROFILE_GVFS, mark);
+    }
+    return true;
+}
+
+// Function to free a job list together with its bind mount lists
+void free_mount_jobs(probe_job_t *jobs, int job_count)
+{
+    for (int i = 0; i < job_count; i++)
+    {
+        for (int j = 0; j < jobs[i].bind_mount_count; j++)
+            free(jobs[i].bind_mounts[j]);
+        free(jobs[i].bind_mounts);
+    }
+    free(jobs);
+}
+
+// Helper: order job indices by device, then by preference as the mount
+// point to show: the whole filesystem, a shorter path, table order
+int compare_jobs_by_dev(const void *a, const void *b, void *context)
+{
+    const probe_job_t *jobs = (const probe_job_t *)context;
+    const probe_job_t *job_a = &jobs[*(const int *)a];
+    const probe_job_t *job_b = &jobs[*(const int *)b];
+    if (job_a->dev != job_b->dev)
+        return job_a->dev < job_b->dev ? -1 : 1;
+    if (job_a->fs_root != job_b->fs_root)
+        return job_a->fs_root ? -1 : 1;
+    size_t length_a = strlen(job_a->mount_point);
+    size_t length_b = strlen(job_b->mount_point);
+    if (length_a != length_b)
+        return length_a < length_b ? -1 : 1;
+    return *(const int *)a - *(const int *)b;
+}
+
+// Function to fold bind mounts and subvolumes of one filesystem into a
+// single job, so each filesystem is probed and reported once. Mounts are
+// grouped by the device number of their superblock (st_dev), which the
+// mount table already has; jobs without one are left alone.
+void group_mount_jobs(probe_job_t *jobs, int *job_count)
+{
+    if (opt_no_dedup || *job_count < 2)
+        return;
+    int *order = malloc((size_t)*job_count * sizeof(int));
+    bool *merged = calloc((size_t)*job_count, sizeof(bool));
+    if (!order || !merged)
+    {
+        free(order);
+        free(merged);
+        return;
+    }
+    for (int i = 0; i < *job_count; i++)
+        order[i] = i;
+    qsort_r(order, (size_t)*job_count, sizeof(int), compare_jobs_by_dev, jobs);
+
+    for (int start = 0; start < *job_count;)
+    {
+        int end = start + 1;
+        while (end < *job_count && jobs[order[end]].dev == jobs[order[start]].dev)
+            end++;
+
+        probe_job_t *primary = &jobs[order[start]];
+        if (primary->dev != 0 && end - start > 1)
+        {
+            primary->bind_mounts = malloc((size_t)(end - start - 1) * sizeof(char *));
+            for (int k = start + 1; primary->bind_mounts && k < end; k++)
+            {
+                char *mount_point = strdup(jobs[order[k]].mount_point);
+                if (!mount_point)
+                    break;
+                primary->bind_mounts[primary->bind_mount_count++] = mount_point;
+                merged[order[k]] = true;
+            }
+        }
+        start = end;
+    }
+
+    // Keep the mount table order of the remaining jobs
+    int kept = 0;
+    for (int i = 0; i < *job_count; i++)
+    {
+        if (!merged[i])
+            jobs[kept++] = jobs[i];
+    }
+    *job_count = kept;
+    free(order);
+    free(merged);
+}
+
+// Helper: hash of the trie edge from parent to the child called name
+size_t mount_trie_hash(int parent, const char *name, size_t length)
+{
+    size_t hash = 14695981039346656037ULL ^ (size_t)parent;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// Helper: rebuild the edge hash with twice the slots
+bool mount_trie_grow(mount_trie_t *trie)
+{
+    size_t slot_count = trie->slot_count ? trie->slot_count * 2 : MOUNT_TRIE_INITIAL_SLOTS;
+    int *slots = calloc(slot_count, sizeof(int));
+    if (!slots)
+        return false;
+    for (int i = 1; i < trie->count; i++)
+    {
+        const mount_trie_node_t *node = &trie->nodes[i];
+        size_t slot = mount_trie_hash(node->parent, node->name, node->name_length) & (slot_count - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i + 1;
+    }
+    free(trie->slots);
+    trie->slots = slots;
+    trie->slot_count = slot_count;
+    return true;
+}
+
+// Function to find the child of parent called name, adding it if insert is
+// set. Returns the node index, or -1 if there is none (or no memory).
+int mount_trie_child(mount_trie_t *trie, int parent, const char *name, size_t length, bool insert)
+{
+    if (insert && (size_t)(trie->count + 1) * 100 > trie->slot_count * MOUNT_TRIE_MAX_LOAD_PERCENT &&
+        !mount_trie_grow(trie))
+        return -1;
+    if (!trie->slot_count)
+        return -1;
+
+    size_t mask = trie->slot_count - 1;
+    size_t slot = mount_trie_hash(parent, name, length) & mask;
+    while (trie->slots[slot])
+    {
+        int index = trie->slots[slot] - 1;
+        const mount_trie_node_t *node = &trie->nodes[index];
+        if (node->parent == parent && node->name_length == length && memcmp(node->name, name, length) == 0)
+            return index;
+        slot = (slot + 1) & mask;
+    }
+    if (!insert)
+        return -1;
+
+    if (trie->count == trie->capacity)
+    {
+        int capacity = trie->capacity * 2;
+        mount_trie_node_t *grown = realloc(trie->nodes, (size_t)capacity * sizeof(mount_trie_node_t));
+        if (!grown)
+            return -1;
+        trie->nodes = grown;
+        trie->capacity = capacity;
+    }
+    int index = trie->count++;
+    trie->nodes[index] = (mount_trie_node_t){parent, name, length, -1};
+    trie->slots[slot] = index + 1;
+    return index;
+}
+
+// Function to start a trie with nothing mounted, not even on /
+bool init_mount_trie(mount_trie_t *trie)
+{
+    memset(trie, 0, sizeof(*trie));
+    trie->capacity = MOUNT_TRIE_INITIAL_SLOTS;
+    trie->nodes = malloc((size_t)trie->capacity * sizeof(mount_trie_node_t));
+    if (!trie->nodes)
+        return false;
+    trie->nodes[0] = (mount_trie_node_t){-1, "", 0, -1};
+    trie->count = 1;
+    return true;
+}
+
+// Function to record mount as what is mounted on mount_point, replacing an
+// earlier one. The trie points into mount_point, which has to stay.
+bool mount_trie_insert(mount_trie_t *trie, const char *mount_point, int mount)
+{
+    const char *p = mount_point;
+    int node = 0;
+    while (node >= 0 && *p)
+    {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        const char *end = strchrnul(p, '/');
+        node = mount_trie_child(trie, node, p, (size_t)(end - p), true);
+        p = end;
+    }
+    if (node < 0)
+        return false;
+    trie->nodes[node].mount = mount;
+    return true;
+}
+
+// Function to build the trie of all mount points of a table. A mount point
+// that appears twice keeps the later (topmost) entry.
+bool build_mount_trie(mount_trie_t *trie, const mount_table_t *table)
+{
+    if (!init_mount_trie(trie))
+        return false;
+    for (int i = 0; i < table->count; i++)
+    {
+        if (!mount_trie_insert(trie, table->entries[i].mount_point, i))
+            return false;
+    }
+    return true;
+}
+
+// Function to find the entry of the longest mount point that is a prefix of
+// an absolute, canonical path. Returns -1 if nothing is mounted on /.
+int mount_trie_lookup(const mount_trie_t *trie, const char *path)
+{
+    int node = 0;
+    int best = trie->nodes[0].mount;
+    const char *p = path;
+    while (*p)
+    {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        const char *end = strchrnul(p, '/');
+        node = mount_trie_child((mount_trie_t *)trie, node, p, (size_t)(end - p), false);
+        if (node < 0)
+            break;
+        if (trie->nodes[node].mount >= 0)
+            best = trie->nodes[node].mount;
+        p = end;
+    }
+    return best;
+}
+
+void free_mount_trie(mount_trie_t *trie)
+{
+    free(trie->nodes);
+    free(trie->slots);
+    memset(trie, 0, sizeof(*trie));
+}
+
+// Helper: whether path lies at or below mount_point
+bool path_is_below(const char *path, const char *mount_point)
+{
+    size_t length = strlen(mount_point);
+    if (length == 1 && mount_point[0] == '/')
+        return true;
+    return strncmp(path, mount_point, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
+
+// Function to resolve a path the trie got wrong (a mount hidden by a later
+// mount on a parent): the longest mount point above it with its st_dev
+int find_mount_by_dev(const mount_table_t *table, const char *path, dev_t dev)
+{
+    int best = -1;
+    size_t best_length = 0;
+    for (int i = 0; i < table->count; i++)
+    {
+        const mount_entry_t *entry = &table->entries[i];
+        size_t length = strlen(entry->mount_point);
+        if (makedev(entry->major, entry->minor) == dev && path_is_below(path, entry->mount_point) &&
+            (best < 0 || length >= best_length))
+        {
+            best = i;
+            best_length = length;
+        }
+    }
+    return best;
+}
+
+// Function to probe a list of mounts concurrently and fill in the drives
+void probe_mounts(const probe_job_t *jobs, int job_count, drive_table_t *drives)
+{
+    clear_drive_table(drives);
+    profile_mark_t mark = profile_begin();
+    probe_job_t *results = run_probes(jobs, job_count, NULL, NULL);
+    profile_end(PROFILE_STATVFS, mark);
+    if (!results)
+        return;
+
+    for (int i = 0; i < job_count; i++)
+    {
+        profile_add_mount(&results[i]);
+        record_probe_latency(&results[i]);
+        // Skip if no information available
+        if (results[i].state != PROBE_DONE && results[i].state != PROBE_TIMEOUT)
+            continue;
+        if (!add_probed_drive(drives, &results[i]))
+            break;
+        if (!where_accepts_drive(drives, drives->count - 1))
+            drives->count--;
+    }
+
+    free(results);
+}
+
+void discover_drives(drive_table_t *drives) {
+    probe_job_t *jobs;
+    int job_count;
+    if (!collect_mount_jobs(&jobs, &job_count, true))
+    {
+        clear_drive_table(drives);
+        return;
+    }
+    profile_mark_t mark = profile_begin();
+    group_mount_jobs(jobs, &job_count);
+    profile_end(PROFILE_DEDUP, mark);
+    probe_mounts(jobs, job_count, drives);
+    free_mount_jobs(jobs, job_count);
+}
+
+// Helper: restore the heap property below slot i of a heap whose top is
+// the drive that sorts last
+void drive_heap_sift_down(uint32_t *heap, int count, int i, drive_table_t *table)
+{
+    for (;;)
+    {
+        int last = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < count && compare_drives(&heap[left], &heap[last], table) > 0)
+            last = left;
+        if (right < count && compare_drives(&heap[right], &heap[last], table) > 0)
+            last = right;
+        if (last == i)
+            return;
+        uint32_t swap = heap[i];
+        heap[i] = heap[last];
+        heap[last] = swap;
+        i = last;
+    }
+}
+
+// Helper: copy row from to row to
+void move_drive_row(drive_table_t *table, int from, int to)
+{
+    table->total_bytes[to] = table->total_bytes[from];
+    table->used_bytes[to] = table->used_bytes[from];
+    table->available_bytes[to] = table->available_bytes[from];
+    table->total_inodes[to] = table->total_inodes[from];
+    table->used_inodes[to] = table->used_inodes[from];
+    table->usage_percent[to] = table->usage_percent[from];
+    table->inode_usage[to] = table->inode_usage[from];
+    table->info[to] = table->info[from];
+}
+
+// Helper: ascending order of row indices
+int compare_row_indices(const void *a, const void *b)
+{
+    uint32_t index_a = *(const uint32_t *)a;
+    uint32_t index_b = *(const uint32_t *)b;
+    return index_a < index_b ? -1 : index_a > index_b;
+}
+
+// Function to keep only the top drives of the table: a bounded max-heap
+// picks them in O(n log top), only they are sorted, and the table is cut
+// down to them so SMART and rendering skip the rest
+void select_top_drives(drive_table_t *table, int top)
+{
+    uint32_t *heap = table->order;
+    uint32_t *rows = malloc((size_t)top * sizeof(uint32_t));
+    if (!rows)
+    {
+        qsort_r(table->order, (size_t)table->count, sizeof(uint32_t), compare_drives, table);
+        return;
+    }
+    for (int i = top / 2 - 1; i >= 0; i--)
+        drive_heap_sift_down(heap, top, i, table);
+    for (int i = top; i < table->count; i++)
+    {
+        uint32_t candidate = (uint32_t)i;
+        if (compare_drives(&candidate, &heap[0], table) < 0)
+        {
+            heap[0] = candidate;
+            drive_heap_sift_down(heap, top, 0, table);
+        }
+    }
+    qsort_r(heap, (size_t)top, sizeof(uint32_t), compare_drives, table);
+
+    // Move the kept rows to the front, lowest index first so no row is
+    // overwritten before it has moved, and point the order at their new places
+    memcpy(rows, heap, (size_t)top * sizeof(uint32_t));
+    qsort(rows, (size_t)top, sizeof(uint32_t), compare_row_indices);
+    for (int k = 0; k < top; k++)
+        move_drive_row(table, (int)rows[k], k);
+    for (int n = 0; n < top; n++)
+    {
+        uint32_t *row = bsearch(&heap[n], rows, (size_t)top, sizeof(uint32_t), compare_row_indices);
+        heap[n] = (uint32_t)(row - rows);
+    }
+    table->count = top;
+    free(rows);
+}
+
+// Function to sort drives by the --sort keys, keeping only the first
+// opt_top of them if set. A full sort only permutes the order index, but
+// --top compacts the kept rows to the front and cuts table->count, so row
+// indices taken before the call are not valid afterwards.
+void sort_drives(drive_table_t *table)
+{
+    for (int i = 0; i < table->count; i++)
+        table->order[i] = (uint32_t)i;
+
+    if (opt_top > 0 && opt_top < table->count)
+        select_top_drives(table, opt_top);
+    else
+        qsort_r(table->order, (size_t)table->count, sizeof(uint32_t), compare_drives, table);
+}
+
+// Function to render the human-readable report
+void render_text_report(strbuf_t *out, const drive_table_t *table, const layout_t *layout)
+{
+    int drive_count = table->count;
+
+    // Display sorted drives
+    for (int n = 0; n < drive_count; n++)
+    {
+        int i = (int)table->order[n];
+        const drive_info_t *drive = &table->info[i];
+
+        // Display drive information
+        if (drive->is_cloud_storage)
+        {
+            strbuf_printf(out, "  %sNetwork Drive %d (%s)%s\n", c_bold_yellow, n + 1, drive->cloud_service_name, c_reset);
+        }
+        else
+        {
+            strbuf_printf(out, "  %s%s %d%s\n", c_bold_yellow, drive->drive_type, n + 1, c_reset);
+        }
+        if (drive->path)
+            strbuf_printf(out, "  Path:          %s\n", drive->path);
+        if (opt_fields & FIELD_MOUNT)
+        {
+            strbuf_printf(out, "  Mount point:   %s\n", drive->mount_point);
+            for (int j = 0; j < drive->bind_mount_count; j++)
+                strbuf_printf(out, "  Also mounted:  %s\n", drive->bind_mounts[j]);
+        }
+        if (opt_fields & FIELD_FILESYSTEM)
+            strbuf_printf(out, "  Filesystem:    %s\n", drive->filesystem);
+        if (opt_fields & FIELD_DEVICE)
+            strbuf_printf(out, "  Device:        %s\n", drive->device);
+        if (opt_fields & FIELD_UUID)
+            strbuf_printf(out, "  UUID:          %s\n", drive->uuid[0] ? drive->uuid : "-");
+        if (opt_fields & FIELD_LABEL)
+            strbuf_printf(out, "  Label:         %s\n", drive->label[0] ? drive->label : "-");
+        if ((opt_fields & FIELD_PARTUUID) && drive->partuuid[0])
+            strbuf_printf(out, "  PARTUUID:      %s\n", drive->partuuid);
+        if ((opt_fields & FIELD_DISK_ID) && drive->disk_id[0])
+            strbuf_printf(out, "  Disk ID:       %s\n", drive->disk_id);
+        if ((opt_fields & FIELD_DISK_PATH) && drive->disk_path[0])
+            strbuf_printf(out, "  Disk path:     %s\n", drive->disk_path);
+        if (opt_fields & FIELD_OPTIONS)
+            strbuf_printf(out, "  Mount options: %s\n", drive->mount_options);
+        if (drive->timed_out)
+        {
+            if (opt_fields & FIELD_STATE)
+                strbuf_printf(out, "  State:         %stimeout%s (no answer from statvfs)\n", c_bold_yellow, c_reset);
+            continue;
+        }
+        char total_str[MAX_SIZE_STR_LENGTH], used_str[MAX_SIZE_STR_LENGTH], available_str[MAX_SIZE_STR_LENGTH];
+        format_bytes(table->total_bytes[i], total_str, sizeof(total_str));
+        format_bytes(table->used_bytes[i], used_str, sizeof(used_str));
+        format_bytes(table->available_bytes[i], available_str, sizeof(available_str));
+        if (opt_fields & FIELD_SIZE)
+            strbuf_printf(out, "  Total size:    %s\n", total_str);
+        if (opt_fields & FIELD_USED)
+            strbuf_printf(out, "  Used:          %s\n", used_str);
+        if (opt_fields & FIELD_AVAILABLE)
+            strbuf_printf(out, "  Available:     %s\n", available_str);
+        if (opt_fields & FIELD_INODES)
+            strbuf_printf(out, "  Inodes:        %llu/%llu (%.1f%% used)\n", table->used_inodes[i],
+                          table->total_inodes[i], table->inode_usage[i]);
+
+        // SMART status only for root and physical devices
+        if (drive->has_smart && (opt_fields & FIELD_SMART))
+        {
+            char smart_summary[MAX_TEMP_BUFFER_LENGTH];
+            format_smart_summary(&drive->smart, smart_summary, sizeof(smart_summary));
+            strbuf_printf(out, "  SMART:         %s\n", smart_summary);
+        }
+
+        // Progress bar
+        if (!(opt_fields & FIELD_USAGE))
+            continue;
+        strbuf_append_str(out, "  ");
+        size_t bar_start = out->length;
+        render_progress_bar(out, table->usage_percent[i], layout->bar_length);
+        int bar_padding = layout->content_width - (out->data ? visible_length(out->data + bar_start) : 0);
+        strbuf_printf(out, "%*s\n", bar_padding, "");
+    }
+
+    if (drive_count == 0)
+    {
+        strbuf_printf(out, "No drives found.\n");
+    }
+    else
+    {
+        strbuf_printf(out, "A total of %d drives found.\n", drive_count);
+    }
+}
+
+// Function to redraw the screen from a new frame, touching only the lines
+// that differ from the previous one (or everything after a resize)
+void draw_frame(screen_t *screen, const char *frame, bool full_redraw)
+{
+    strbuf_t out = {0};
+    if (full_redraw)
+    {
+        strbuf_append_str(&out, "\033[H\033[2J");
+        screen->line_count = 0;
+    }
+
+    // Split the new frame into lines, keeping our own copy for the next diff
+    char *text = strdup(frame);
+    if (!text)
+        return;
+    int line_count = 0, line_capacity = 0;
+    char **lines = NULL;
+    for (char *line = text; *line;)
+    {
+        char *newline = strchr(line, '\n');
+        if (newline)
+            *newline = '\0';
+        if (line_count == line_capacity)
+        {
+            line_capacity = line_capacity ? line_capacity * 2 : 64;
+            char **grown = realloc(lines, (size_t)line_capacity * sizeof(char *));
+            if (!grown)
+                break;
+            lines = grown;
+        }
+        lines[line_count++] = line;
+        if (!newline)
+            break;
+        line = newline + 1;
+    }
+
+    for (int i = 0; i < line_count && i < screen->rows; i++)
+    {
+        if (full_redraw || i >= screen->line_count || strcmp(screen->lines[i], lines[i]) != 0)
+            strbuf_printf(&out, "\033[%d;1H%s\033[K", i + 1, lines[i]);
+    }
+    for (int i = line_count; i < screen->line_count && i < screen->rows; i++)
+        strbuf_printf(&out, "\033[%d;1H\033[K", i + 1);
+
+    if (out.length > 0)
+    {
+        // One write per frame so the terminal never shows half an update
+        write_all(STDOUT_FILENO, out.data, out.length);
+    }
+    strbuf_free(&out);
+
+    free(screen->lines);
+    free(screen->text);
+    screen->lines = lines;
+    screen->line_count = line_count;
+    screen->text = text;
+}
+
+// Helper: append a string and its terminating NUL to a snapshot payload
+void snapshot_put_string(strbuf_t *out, const char *s)
+{
+    strbuf_append(out, s, strlen(s) + 1);
+}
+
+// Function to serialize the drive table for the snapshot. Numbers are
+// stored in host byte order: the snapshot never leaves the machine.
+void encode_snapshot(strbuf_t *out, const drive_table_t *table)
+{
+    uint32_t count = (uint32_t)table->count;
+    strbuf_append(out, (const char *)&count, sizeof(count));
+    for (int n = 0; n < table->count; n++)
+    {
+        int i = (int)table->order[n];
+        const drive_info_t *d = &table->info[i];
+        unsigned long long numbers[] = {table->total_bytes[i], table->used_bytes[i], table->available_bytes[i],
+                                        table->total_inodes[i], table->used_inodes[i]};
+        double percents[] = {table->usage_percent[i], table->inode_usage[i]};
+        long long smart[] = {d->smart.temperature, d->smart.power_on_hours, d->smart.percentage_used,
+                             d->smart.reallocated_sectors};
+        unsigned char flags[] = {d->is_cloud_storage, d->timed_out, d->has_smart};
+        uint32_t bind_mount_count = (uint32_t)d->bind_mount_count;
+        strbuf_append(out, (const char *)numbers, sizeof(numbers));
+        strbuf_append(out, (const char *)percents, sizeof(percents));
+        strbuf_append(out, (const char *)smart, sizeof(smart));
+        strbuf_append(out, (const char *)flags, sizeof(flags));
+        snapshot_put_string(out, d->mount_point);
+        snapshot_put_string(out, d->filesystem);
+        snapshot_put_string(out, d->device);
+        snapshot_put_string(out, d->uuid);
+        snapshot_put_string(out, d->label);
+        snapshot_put_string(out, d->partuuid);
+        snapshot_put_string(out, d->disk_id);
+        snapshot_put_string(out, d->disk_path);
+        snapshot_put_string(out, d->mount_options);
+        snapshot_put_string(out, d->drive_type);
+        snapshot_put_string(out, d->cloud_service_name);
+        snapshot_put_string(out, d->smart.status);
+        strbuf_append(out, (const char *)&bind_mount_count, sizeof(bind_mount_count));
+        for (int j = 0; j < d->bind_mount_count; j++)
+            snapshot_put_string(out, d->bind_mounts[j]);
+    }
+}
+
+// Function to tell which options of the daemon narrowed its table. Plain
+// runs read a snapshot only if it is the whole host.
+uint32_t snapshot_scope(void)
+{
+    uint32_t scope = 0;
+    if (where_program.count > 0)
+        scope |= SNAPSHOT_SCOPE_WHERE;
+    if (opt_top > 0)
+        scope |= SNAPSHOT_SCOPE_TOP;
+    if (system_root[0])
+        scope |= SNAPSHOT_SCOPE_ROOT;
+    if (opt_no_dedup)
+        scope |= SNAPSHOT_SCOPE_NO_DEDUP;
+    return scope;
+}
+
+// Function to tell how old the snapshot may get before readers give up on
+// the daemon: a few intervals plus one scan that runs into its timeouts,
+// statvfs() (or --deadline) and then smartctl
+uint32_t snapshot_stale_after(void)
+{
+    long long ms = (long long)SNAPSHOT_STALE_INTERVALS * opt_watch_seconds * MS_PER_SECOND;
+    ms += opt_deadline_ms > 0 ? opt_deadline_ms : opt_timeout_ms;
+    ms += opt_timeout_ms;
+    return (uint32_t)((ms + MS_PER_SECOND - 1) / MS_PER_SECOND);
+}
+
+// Function to create a snapshot file with room for capacity payload bytes
+// and the current payload, then put it in place of the old one. Readers
+// that still map the old file keep seeing its last, complete payload.
+bool create_snapshot_file(snapshot_writer_t *writer, size_t capacity)
+{
+    char temporary[MAX_PATH_LENGTH];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp.%ld", opt_snapshot, (long)getpid()) >= (int)sizeof(temporary))
+    {
+        fprintf(stderr, "%s: path too long\n", opt_snapshot);
+        return false;
+    }
+    size_t size = sizeof(snapshot_header_t) + capacity;
+    int fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, OUTPUT_FILE_MODE);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", temporary, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        unlink(temporary);
+        return false;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap");
+        unlink(temporary);
+        return false;
+    }
+
+    snapshot_header_t *header = map;
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->daemon_pid = (uint32_t)getpid();
+    header->interval = (uint32_t)opt_watch_seconds;
+    header->scope = snapshot_scope();
+    header->fields = opt_fields;
+    header->stale_after = snapshot_stale_after();
+    header->capacity = capacity;
+    header->length = writer->payload.length;
+    header->updated = (int64_t)time(NULL);
+    memcpy(header + 1, writer->payload.data, writer->payload.length);
+    if (rename(temporary, opt_snapshot) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", opt_snapshot, strerror(errno));
+        munmap(map, size);
+        unlink(temporary);
+        return false;
+    }
+
+    if (writer->header)
+        munmap(writer->header, writer->size);
+    writer->header = header;
+    writer->size = size;
+    return true;
+}
+
+// Function to publish the drive table to the snapshot. In place, the
+// payload is rewritten under the seqlock; a file that is too small is
+// replaced by a larger one.
+void publish_snapshot(snapshot_writer_t *writer, const drive_table_t *table)
+{
+    strbuf_reset(&writer->payload);
+    encode_snapshot(&writer->payload, table);
+    if (writer->payload.failed)
+    {
+        fprintf(stderr, "Error: out of memory while building the snapshot\n");
+        return;
+    }
+
+    size_t length = writer->payload.length;
+    if (!writer->header || length > writer->header->capacity)
+    {
+        size_t capacity = SNAPSHOT_MIN_CAPACITY;
+        while (capacity < 2 * length)
+            capacity *= 2;
+        create_snapshot_file(writer, capacity);
+        return;
+    }
+
+    snapshot_header_t *header = writer->header;
+    uint32_t sequence = header->sequence;
+    __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header + 1, writer->payload.data, length);
+    __atomic_store_n(&header->length, (uint64_t)length, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->updated, (int64_t)time(NULL), __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Function to withdraw the snapshot when the daemon stops, so readers scan
+// again right away instead of waiting for it to go stale
+void close_snapshot(snapshot_writer_t *writer)
+{
+    if (writer->header)
+    {
+        munmap(writer->header, writer->size);
+        unlink(opt_snapshot);
+    }
+    strbuf_free(&writer->payload);
+    memset(writer, 0, sizeof(*writer));
+}
+
+// Helper: take size bytes from the payload
+void snapshot_get(snapshot_reader_t *reader, void *value, size_t size)
+{
+    if (reader->failed || (size_t)(reader->end - reader->cursor) < size)
+    {
+        reader->failed = true;
+        memset(value, 0, size);
+        return;
+    }
+    memcpy(value, reader->cursor, size);
+    reader->cursor += size;
+}
+
+// Helper: take a NUL-terminated string from the payload ("" past the end)
+const char *snapshot_get_string(snapshot_reader_t *reader)
+{
+    const char *end = reader->failed ? NULL : memchr(reader->cursor, '\0', (size_t)(reader->end - reader->cursor));
+    if (!end)
+    {
+        reader->failed = true;
+        return "";
+    }
+    const char *s = reader->cursor;
+    reader->cursor = end + 1;
+    return s;
+}
+
+// Function to turn a snapshot payload back into drive table rows, keeping
+// those that pass --where
+bool decode_snapshot(const char *payload, size_t length, drive_table_t *table)
+{
+    snapshot_reader_t reader = {payload, payload + length, false};
+    string_arena_t *strings = &table->strings;
+    uint32_t count;
+    snapshot_get(&reader, &count, sizeof(count));
+    for (uint32_t n = 0; n < count && !reader.failed; n++)
+    {
+        if (!reserve_drive_row(table))
+            return false;
+        int i = table->count;
+        drive_info_t *d = &table->info[i];
+        unsigned long long numbers[5];
+        double percents[2];
+        long long smart[4];
+        unsigned char flags[3];
+        uint32_t bind_mount_count;
+        snapshot_get(&reader, numbers, sizeof(numbers));
+        snapshot_get(&reader, percents, sizeof(percents));
+        snapshot_get(&reader, smart, sizeof(smart));
+        snapshot_get(&reader, flags, sizeof(flags));
+
+        memset(d, 0, sizeof(*d));
+        table->total_bytes[i] = numbers[0];
+        table->used_bytes[i] = numbers[1];
+        table->available_bytes[i] = numbers[2];
+        table->total_inodes[i] = numbers[3];
+        table->used_inodes[i] = numbers[4];
+        table->usage_percent[i] = percents[0];
+        table->inode_usage[i] = percents[1];
+        d->smart.temperature = smart[0];
+        d->smart.power_on_hours = smart[1];
+        d->smart.percentage_used = smart[2];
+        d->smart.reallocated_sectors = smart[3];
+        d->is_cloud_storage = flags[0];
+        d->timed_out = flags[1];
+        d->has_smart = flags[2];
+        d->mount_point = arena_strdup(strings, snapshot_get_string(&reader));
+        d->filesystem = arena_intern(strings, snapshot_get_string(&reader));
+        d->device = arena_strdup(strings, snapshot_get_string(&reader));
+        d->uuid = arena_strdup(strings, snapshot_get_string(&reader));
+        d->label = arena_strdup(strings, snapshot_get_string(&reader));
+        d->partuuid = arena_strdup(strings, snapshot_get_string(&reader));
+        d->disk_id = arena_strdup(strings, snapshot_get_string(&reader));
+        d->disk_path = arena_strdup(strings, snapshot_get_string(&reader));
+        d->mount_options = arena_intern(strings, snapshot_get_string(&reader));
+        d->drive_type = arena_intern(strings, snapshot_get_string(&reader));
+        d->cloud_service_name = arena_intern(strings, snapshot_get_string(&reader));
+        snprintf(d->smart.status, sizeof(d->smart.status), "%s", snapshot_get_string(&reader));
+        snapshot_get(&reader, &bind_mount_count, sizeof(bind_mount_count));
+        if (bind_mount_count > 0 && bind_mount_count <= (uint32_t)(reader.end - reader.cursor))
+        {
+            d->bind_mounts = arena_alloc(strings, (size_t)bind_mount_count * sizeof(char *));
+            for (uint32_t j = 0; d->bind_mounts && j < bind_mount_count; j++)
+                d->bind_mounts[d->bind_mount_count++] = arena_strdup(strings, snapshot_get_string(&reader));
+        }
+        else if (bind_mount_count > 0)
+        {
+            reader.failed = true;
+        }
+
+        table->order[i] = (uint32_t)i;
+        table->count++;
+        if (!where_matches_drive(&where_program, table, i))
+            table->count--;
+    }
+    return !reader.failed;
+}
+
+// Function to load the drives from a running daemon's snapshot instead of
+// scanning. Returns false, with the table empty, if there is no usable
+// snapshot: no file, a stopped or stuck daemon, a daemon that publishes
+// fewer drives or fields than this run shows, or a payload that kept
+// changing while it was copied.
+bool read_snapshot(drive_table_t *table)
+{
+    int fd = open(opt_snapshot, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(snapshot_header_t))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const snapshot_header_t *header = map;
+    const char *payload = (const char *)(header + 1);
+    size_t capacity = (size_t)st.st_size - sizeof(snapshot_header_t);
+    char *copy = NULL;
+    size_t length = SIZE_MAX; // Until a consistent copy is made
+    bool ok = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+              header->capacity <= capacity && header->scope == 0 && (opt_fields & ~header->fields) == 0 &&
+              (kill((pid_t)header->daemon_pid, 0) == 0 || errno == EPERM) &&
+              time(NULL) - (time_t)header->updated <= (time_t)header->stale_after;
+    if (ok)
+        copy = malloc(header->capacity ? header->capacity : 1);
+    ok = copy != NULL;
+
+    for (int attempt = 0; ok && attempt < SNAPSHOT_READ_ATTEMPTS; attempt++)
+    {
+        uint32_t before = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        size_t copied = (size_t)__atomic_load_n(&header->length, __ATOMIC_RELAXED);
+        if (copied > header->capacity)
+            continue;
+        memcpy(copy, payload, copied);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == before)
+        {
+            length = copied;
+            break;
+        }
+    }
+    munmap(map, (size_t)st.st_size);
+
+    ok = ok && length != SIZE_MAX && decode_snapshot(copy, length, table);
+    free(copy);
+    if (!ok)
+        clear_drive_table(table);
+    return ok;
+}
+
+// Helper: whether drive i is mounted at mount_point, directly or as a
+// bind mount
+bool drive_has_mount_point(const drive_table_t *table, int i, const char *mount_point)
+{
+    const drive_info_t *d = &table->info[i];
+    if (strcmp(d->mount_point, mount_point) == 0)
+        return true;
+    for (int j = 0; j < d->bind_mount_count; j++)
+        if (strcmp(d->bind_mounts[j], mount_point) == 0)
+            return true;
+    return false;
+}
+
+// Function to make an absolute path canonical without touching the
+// filesystem: empty and "." components go, ".." drops the one before it.
+// Symlinks are not followed. Returns false if path is relative or too long.
+bool normalize_path(const char *path, char *out, size_t size)
+{
+    if (path[0] != '/')
+        return false;
+    size_t length = 0;
+    const char *p = path;
+    while (*p)
+    {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        const char *end = strchrnul(p, '/');
+        size_t n = (size_t)(end - p);
+        if (n == 2 && p[0] == '.' && p[1] == '.')
+        {
+            while (length > 0 && out[length - 1] != '/')
+                length--;
+            if (length > 0)
+                length--;
+        }
+        else if (n != 1 || p[0] != '.')
+        {
+            if (length + n + 2 > size)
+                return false;
+            out[length++] = '/';
+            memcpy(out + length, p, n);
+            length += n;
+        }
+        p = end;
+    }
+    if (length == 0)
+        out[length++] = '/';
+    out[length] = '\0';
+    return true;
+}
+
+// Function to index the mount points and bind mounts of the drives queries
+// are answered from. Without memory for it, path= finds nothing.
+void index_query_drives(query_server_t *server, const drive_table_t *table)
+{
+    free_mount_trie(&server->mount_points);
+    if (!init_mount_trie(&server->mount_points))
+        return;
+    for (int i = 0; i < table->count; i++)
+    {
+        const drive_info_t *d = &table->info[i];
+        bool ok = mount_trie_insert(&server->mount_points, d->mount_point, i);
+        for (int j = 0; ok && j < d->bind_mount_count; j++)
+            ok = mount_trie_insert(&server->mount_points, d->bind_mounts[j], i);
+        if (!ok)
+        {
+            free_mount_trie(&server->mount_points);
+            return;
+        }
+    }
+}
+
+// Helper: append a response frame with an error message
+void query_error(strbuf_t *out, const char *format, ...)
+{
+    char message[MAX_TEMP_BUFFER_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (length < 0)
+        length = 0;
+    if ((size_t)length >= sizeof(message))
+        length = (int)sizeof(message) - 1;
+    unsigned char status = QUERY_STATUS_ERROR;
+    binary_append_be(out, (uint64_t)length + 1, QUERY_LENGTH_BYTES);
+    strbuf_append(out, (const char *)&status, 1);
+    strbuf_append(out, message, (size_t)length);
+}
+
+// Function to parse one request of the query socket: a list of
+// NUL-terminated "key=value" items. mount, device, uuid and path select
+// drives (all given must match), where and fields work as the options of
+// the same name, and format is json (default), cbor or msgpack. Returns
+// false after appending an error response.
+bool parse_query(char *request, size_t length, query_t *query, strbuf_t *out)
+{
+    for (char *item = request, *next; item < request + length; item = next)
+    {
+        next = item + strlen(item) + 1;
+        char *value = strchr(item, '=');
+        if (!value)
+        {
+            query_error(out, "expected key=value: %s", item);
+            return false;
+        }
+        *value++ = '\0';
+
+        if (strcmp(item, "mount") == 0)
+            query->mount = value;
+        else if (strcmp(item, "device") == 0)
+            query->device = value;
+        else if (strcmp(item, "uuid") == 0)
+            query->uuid = value;
+        else if (strcmp(item, "path") == 0)
+            query->path = value;
+        else if (strcmp(item, "where") == 0)
+        {
+            const char *error_at;
+            const char *error = where_compile(&query->filter, value, &error_at);
+            if (error)
+            {
+                if (*error_at)
+                    query_error(out, "invalid where expression: %s at '%s'", error, error_at);
+                else
+                    query_error(out, "invalid where expression: %s", error);
+                return false;
+            }
+        }
+        else if (strcmp(item, "fields") == 0)
+        {
+            const char *bad = parse_field_list(value, &query->fields);
+            if (bad)
+            {
+                query_error(out, "invalid field: %s", bad);
+                return false;
+            }
+        }
+        else if (strcmp(item, "format") == 0)
+        {
+            if (strcmp(value, "json") == 0)
+                query->format = FORMAT_JSON;
+            else if (strcmp(value, "cbor") == 0)
+                query->format = FORMAT_CBOR;
+            else if (strcmp(value, "msgpack") == 0)
+                query->format = FORMAT_MSGPACK;
+            else
+            {
+                query_error(out, "invalid format: %s", value);
+                return false;
+            }
+        }
+        else
+        {
+            query_error(out, "unknown key: %s", item);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Helper: whether drive i is selected by every key of the query
+bool query_matches_drive(const query_t *query, const drive_table_t *table, int i, int path_drive)
+{
+    const drive_info_t *d = &table->info[i];
+    if (query->path && i != path_drive)
+        return false;
+    if (query->mount && !drive_has_mount_point(table, i, query->mount))
+        return false;
+    if (query->device && strcmp(d->device, query->device) != 0)
+        return false;
+    if (query->uuid && strcmp(d->uuid, query->uuid) != 0)
+        return false;
+    return where_matches_drive(&query->filter, table, i);
+}
+
+// Function to answer one request of the query socket. The response frame
+// holds a status byte and then the matching drives in table order, or an
+// error message.
+void handle_query(const drive_table_t *table, const mount_trie_t *mount_points, char *request, size_t length,
+                  strbuf_t *out)
+{
+    query_t query = {.fields = FIELD_ALL, .format = FORMAT_JSON};
+    if (!parse_query(request, length, &query, out))
+    {
+        free_where_program(&query.filter);
+        return;
+    }
+    // path= is looked up as written: resolving it could hang the daemon on
+    // a dead mount and would tell clients what exists with its permissions
+    int path_drive = -1;
+    if (query.path)
+    {
+        char path[PATH_MAX];
+        if (!normalize_path(query.path, path, sizeof(path)))
+        {
+            query_error(out, "invalid path: %s", query.path);
+            free_where_program(&query.filter);
+            return;
+        }
+        path_drive = mount_points->nodes ? mount_trie_lookup(mount_points, path) : -1;
+    }
+
+    unsigned int fields = query.fields & opt_fields;
+    size_t start = out->length;
+    unsigned char status = QUERY_STATUS_OK;
+    binary_append_be(out, 0, QUERY_LENGTH_BYTES);
+    strbuf_append(out, (const char *)&status, 1);
+    if (query.format == FORMAT_JSON)
+    {
+        bool first = true;
+        strbuf_append(out, "[", 1);
+        for (int n = 0; n < table->count; n++)
+        {
+            int i = (int)table->order[n];
+            if (!query_matches_drive(&query, table, i, path_drive))
+                continue;
+            strbuf_append_str(out, first ? "{" : ", {");
+            render_json_drive(out, table, i, NULL, fields);
+            strbuf_append(out, "}", 1);
+            first = false;
+        }
+        strbuf_append(out, "]", 1);
+    }
+    else
+    {
+        // The array header needs the count before the drives
+        binary_format = query.format;
+        size_t match_count = 0;
+        for (int n = 0; n < table->count; n++)
+            match_count += query_matches_drive(&query, table, (int)table->order[n], path_drive);
+        binary_append_header(out, BINARY_ARRAY, match_count);
+        for (int n = 0; n < table->count; n++)
+        {
+            int i = (int)table->order[n];
+            if (query_matches_drive(&query, table, i, path_drive))
+                render_binary_drive(out, table, i, fields);
+        }
+    }
+    free_where_program(&query.filter);
+
+    // Fill in the frame length now that the body is there
+    if (!out->failed)
+    {
+        uint64_t frame = out->length - start - QUERY_LENGTH_BYTES;
+        for (int b = QUERY_LENGTH_BYTES - 1; b >= 0; b--, frame >>= 8)
+            out->data[start + (size_t)b] = (char)(frame & 0xff);
+    }
+}
+
+// Function to open the query socket of --daemon and watch it with epoll.
+// Without one the daemon still publishes its snapshot.
+void open_query_socket(query_server_t *server, int epoll_fd)
+{
+    server->listen_fd = -1;
+    if (!opt_socket[0])
+        return;
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(opt_socket) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "%s: path too long\n", opt_socket);
+        return;
+    }
+    strcpy(address.sun_path, opt_socket);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return;
+    }
+    // A socket file left behind by a daemon that did not exit cleanly
+    unlink(opt_socket);
+    // Created with its final mode, so no one connects before the group is set
+    mode_t previous_umask = umask(~opt_socket_mode & 0777);
+    int rc = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    umask(previous_umask);
+    if (rc != 0 || (opt_socket_group != (gid_t)-1 && chown(opt_socket, (uid_t)-1, opt_socket_group) != 0) ||
+        chmod(opt_socket, opt_socket_mode) != 0 || listen(fd, QUERY_LISTEN_BACKLOG) != 0)
+    {
+        fprintf(stderr, "%s: %s\n", opt_socket, strerror(errno));
+        close(fd);
+        return;
+    }
+    struct epoll_event event = {.events = EPOLLIN};
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    server->listen_fd = fd;
+}
+
+// Helper: the client on descriptor fd, NULL if fd is no client
+query_client_t *find_query_client(const query_server_t *server, int fd)
+{
+    return fd >= 0 && fd < server->client_capacity ? server->clients[fd] : NULL;
+}
+
+void close_query_client(query_server_t *server, int fd)
+{
+    query_client_t *client = server->clients[fd];
+    strbuf_free(&client->in);
+    strbuf_free(&client->out);
+    free(client);
+    server->clients[fd] = NULL;
+    close(fd); // Also drops it from the epoll set
+}
+
+// Function to take every pending connection off the listening socket
+void accept_query_clients(query_server_t *server, int epoll_fd)
+{
+    for (;;)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; // EAGAIN once all are accepted
+        if (fd >= server->client_capacity)
+        {
+            int capacity = server->client_capacity ? server->client_capacity : 16;
+            while (capacity <= fd)
+                capacity *= 2;
+            query_client_t **grown = realloc(server->clients, (size_t)capacity * sizeof(query_client_t *));
+            if (!grown)
+            {
+                close(fd);
+                continue;
+            }
+            memset(grown + server->client_capacity, 0,
+                   (size_t)(capacity - server->client_capacity) * sizeof(query_client_t *));
+            server->clients = grown;
+            server->client_capacity = capacity;
+        }
+        query_client_t *client = calloc(1, sizeof(query_client_t));
+        struct epoll_event event = {.events = EPOLLIN};
+        event.data.fd = fd;
+        if (!client || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            free(client);
+            close(fd);
+            continue;
+        }
+        server->clients[fd] = client;
+    }
+}
+
+// Function to send what a client can take now. Returns false if the
+// connection is gone. While output is left, the client is also watched for
+// EPOLLOUT.
+bool flush_query_client(query_client_t *client, int fd, int epoll_fd)
+{
+    bool pending_before = client->sent < client->out.length;
+    while (client->sent < client->out.length)
+    {
+        ssize_t n = send(fd, client->out.data + client->sent, client->out.length - client->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+            return false;
+        client->sent += (size_t)n;
+    }
+    bool pending = client->sent < client->out.length;
+    if (!pending)
+    {
+        strbuf_reset(&client->out);
+        client->sent = 0;
+    }
+    if (pending != pending_before)
+    {
+        struct epoll_event event = {.events = EPOLLIN | (pending ? EPOLLOUT : 0)};
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+    return true;
+}
+
+// Function to read what a client sent, answer every complete request in
+// it and send the answers
+void serve_query_client(query_server_t *server, int fd, uint32_t events, int epoll_fd,
+                        const drive_table_t *table)
+{
+    query_client_t *client = server->clients[fd];
+    bool open = !(events & (EPOLLERR | EPOLLHUP)) || (events & EPOLLIN);
+    while (open && (events & EPOLLIN))
+    {
+        if (!strbuf_reserve(&client->in, QUERY_READ_CHUNK))
+        {
+            open = false;
+            break;
+        }
+        ssize_t n = recv(fd, client->in.data + client->in.length, QUERY_READ_CHUNK, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            open = false;
+            break;
+        }
+        client->in.length += (size_t)n;
+    }
+
+    size_t used = 0;
+    while (open && client->in.length - used >= QUERY_LENGTH_BYTES)
+    {
+        // A client that sends requests but does not read the answers
+        if (client->out.failed || client->out.length - client->sent > QUERY_MAX_PENDING)
+        {
+            open = false;
+            break;
+        }
+        const unsigned char *header = (const unsigned char *)client->in.data + used;
+        size_t length = (size_t)header[0] << 24 | (size_t)header[1] << 16 | (size_t)header[2] << 8 | header[3];
+        if (length > QUERY_MAX_REQUEST)
+        {
+            open = false;
+            break;
+        }
+        if (client->in.length - used - QUERY_LENGTH_BYTES < length)
+            break;
+        char *request = client->in.data + used + QUERY_LENGTH_BYTES;
+        // The request is parsed in place; its last item may lack the NUL
+        char last = request[length];
+        request[length] = '\0';
+        handle_query(table, &server->mount_points, request, length, &client->out);
+        request[length] = last;
+        used += QUERY_LENGTH_BYTES + length;
+    }
+    if (used > 0)
+    {
+        memmove(client->in.data, client->in.data + used, client->in.length - used);
+        client->in.length -= used;
+    }
+
+    if (open)
+        open = !client->out.failed && flush_query_client(client, fd, epoll_fd);
+    if (!open)
+        close_query_client(server, fd);
+}
+
+// Function to close the query socket and every connection to it
+void close_query_socket(query_server_t *server)
+{
+    for (int fd = 0; fd < server->client_capacity; fd++)
+        if (server->clients[fd])
+            close_query_client(server, fd);
+    free(server->clients);
+    free_mount_trie(&server->mount_points);
+    if (server->listen_fd >= 0)
+    {
+        close(server->listen_fd);
+        unlink(opt_socket);
+    }
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+}
+
+// Function to bring the cached mount list up to date after the mount table
+// changed. With listmount() only mounts that are new, or that are being
+// shown, are looked up again; mounts filtered out before are skipped, which
+// matters on hosts with thousands of container mounts.
+void refresh_mount_cache(mount_cache_t *mounts)
+{
+    uint64_t *ids = NULL;
+    int id_count = mount_backend == MOUNT_BACKEND_PROCFS || system_root[0] ? -1 : list_mount_ids(&ids);
+    if (id_count > 0)
+        qsort(ids, (size_t)id_count, sizeof(uint64_t), compare_mount_ids);
+
+    mount_table_t table;
+    bool loaded;
+    uint64_t *wanted = id_count > 0 ? malloc((size_t)id_count * sizeof(uint64_t)) : NULL;
+    if (wanted)
+    {
+        int wanted_count = 0;
+        for (int i = 0; i < id_count; i++)
+        {
+            bool reported = mounts->reported_count > 0 &&
+                            bsearch(&ids[i], mounts->reported_ids, (size_t)mounts->reported_count,
+                                    sizeof(uint64_t), compare_mount_ids);
+            bool seen = mounts->seen_count > 0 &&
+                        bsearch(&ids[i], mounts->seen_ids, (size_t)mounts->seen_count,
+                                sizeof(uint64_t), compare_mount_ids);
+            if (reported || !seen)
+                wanted[wanted_count++] = ids[i];
+        }
+        loaded = read_mount_table(&table, wanted, wanted_count);
+        free(wanted);
+        if (!loaded && mount_backend == MOUNT_BACKEND_PROCFS)
+            loaded = read_mount_table(&table, NULL, 0);
+    }
+    else
+    {
+        loaded = read_mount_table(&table, NULL, 0);
+    }
+
+    free_mount_jobs(mounts->jobs, mounts->job_count);
+    mounts->jobs = NULL;
+    mounts->job_count = 0;
+    int job_capacity = 0;
+    if (loaded)
+    {
+        add_mount_table_jobs(&table, &mounts->jobs, &mounts->job_count, &job_capacity);
+        free_mount_table(&table);
+    }
+
+    // Remember which mounts are reported before bind mounts are folded
+    free(mounts->reported_ids);
+    mounts->reported_ids = malloc((size_t)(mounts->job_count + 1) * sizeof(uint64_t));
+    mounts->reported_count = 0;
+    for (int i = 0; mounts->reported_ids && i < mounts->job_count; i++)
+        mounts->reported_ids[mounts->reported_count++] = mounts->jobs[i].mount_id;
+    if (mounts->reported_ids)
+        qsort(mounts->reported_ids, (size_t)mounts->reported_count, sizeof(uint64_t), compare_mount_ids);
+
+    group_mount_jobs(mounts->jobs, &mounts->job_count);
+    add_cloud_storage_jobs(&mounts->jobs, &mounts->job_count, &job_capacity);
+
+    // After a failed read, look everything up again next time
+    free(mounts->seen_ids);
+    mounts->seen_ids = loaded ? ids : NULL;
+    mounts->seen_count = loaded && id_count > 0 ? id_count : 0;
+    if (!loaded)
+        free(ids);
+}
+
+// Function to probe the mounts again and sort and collect SMART data for
+// the result. The mount table is only parsed again when it has changed
+// since the last scan.
+void rescan_drives(drive_table_t *drives, mount_cache_t *mounts)
+{
+    if (mounts->stale)
+    {
+        refresh_mount_cache(mounts);
+        // New mounts may come with new devices
+        disk_index_reset(&disk_index);
+        mounts->stale = false;
+    }
+    probe_mounts(mounts->jobs, mounts->job_count, drives);
+    sort_drives(drives);
+    collect_smart_info(drives);
+}
+
+// Thread of a --daemon scan
+void *daemon_scan_main(void *arg)
+{
+    daemon_scan_t *scan = arg;
+    rescan_drives(&scan->table, scan->mounts);
+    char done = 1;
+    if (write(scan->done_fds[1], &done, 1) != 1)
+        perror("write");
+    return NULL;
+}
+
+// Function to start a --daemon scan on its own thread, or to note that
+// another one is due when the running scan ends
+void start_daemon_scan(daemon_scan_t *scan)
+{
+    if (scan->running)
+    {
+        scan->requested = true;
+        return;
+    }
+    scan->requested = false;
+    scan->mounts->stale |= scan->mounts_changed;
+    scan->mounts_changed = false;
+    int rc = pthread_create(&scan->thread, NULL, daemon_scan_main, scan);
+    if (rc != 0)
+        fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+    scan->running = rc == 0;
+}
+
+// Function to take the table of a finished --daemon scan: it replaces the
+// one queries are answered from and is published as the new snapshot
+void finish_daemon_scan(daemon_scan_t *scan, drive_table_t *drives, query_server_t *queries)
+{
+    char done;
+    if (read(scan->done_fds[0], &done, 1) != 1 || !scan->running)
+        return;
+    pthread_join(scan->thread, NULL);
+    scan->running = false;
+
+    drive_table_t previous = *drives;
+    *drives = scan->table;
+    scan->table = previous; // Reused by the next scan
+    index_query_drives(queries, drives);
+    publish_snapshot(&snapshot_writer, drives);
+    if (scan->requested)
+        start_daemon_scan(scan);
+}
+
+// Function to collect, sort and draw one watch-mode frame
+void watch_refresh(drive_table_t *drives, mount_cache_t *mounts, bool reprobe,
+                   screen_t *screen, const layout_t *layout, bool full_redraw)
+{
+    if (reprobe)
+        rescan_drives(drives, mounts);
+
+    if (opt_format != FORMAT_TEXT)
+    {
+        // JSON and binary consumers get one complete document per refresh,
+        // no redraws
+        print_document(drives);
+        return;
+    }
+
+    strbuf_t frame = {0};
+    char stamp[MAX_SIZE_STR_LENGTH];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&now));
+    strbuf_printf(&frame, "%sEvery %ds: drinfo%s  %s\n\n", c_bold_yellow, opt_watch_seconds, c_reset, stamp);
+    render_text_report(&frame, drives, layout);
+    if (frame.data && screen->interactive)
+    {
+        draw_frame(screen, frame.data, full_redraw);
+    }
+    else if (opt_output)
+    {
+        write_output(&frame);
+    }
+    else if (frame.data)
+    {
+        // Not a terminal: append plain frames, one after the other
+        fwrite(frame.data, 1, frame.length, stdout);
+        fputc('\n', stdout);
+        fflush(stdout);
+    }
+    strbuf_free(&frame);
+}
+
+// Function to keep the report on screen and refresh it every
+// opt_watch_seconds. A timerfd drives the refreshes; SIGWINCH (through a
+// signalfd) is the only time the layout is recomputed. The kernel flags
+// the mount table with POLLPRI when a mount changes, which triggers an
+// immediate refresh and the only reparse of the table.
+int run_watch()
+{
+    // Block the signals before any worker thread exists, so they all inherit the mask
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+    {
+        perror("sigprocmask");
+        return 1;
+    }
+
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd < 0 || timer_fd < 0 || epoll_fd < 0)
+    {
+        perror("watch");
+        return 1;
+    }
+
+    struct itimerspec interval = {{opt_watch_seconds, 0}, {opt_watch_seconds, 0}};
+    timerfd_settime(timer_fd, 0, &interval, NULL);
+
+    struct epoll_event event = {.events = EPOLLIN};
+    event.data.fd = signal_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+    event.data.fd = timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+    // Without change notification every refresh has to reparse the table
+    mount_cache_t mounts = {NULL, 0, true, NULL, 0, NULL, 0};
+    bool mounts_notify = false;
+    char mounts_path[MAX_ROOTED_PATH_LENGTH];
+    int mounts_fd = open(mount_table_path(mounts_path, sizeof(mounts_path)), O_RDONLY | O_CLOEXEC);
+    if (mounts_fd >= 0)
+    {
+        event.events = EPOLLPRI | EPOLLERR;
+        event.data.fd = mounts_fd;
+        mounts_notify = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mounts_fd, &event) == 0;
+    }
+
+    drive_table_t drives = {0};
+    query_server_t queries = {.listen_fd = -1};
+    daemon_scan_t scan = {.mounts = &mounts, .done_fds = {-1, -1}};
+    if (opt_daemon)
+    {
+        if (pipe2(scan.done_fds, O_CLOEXEC) != 0)
+        {
+            perror("pipe");
+            return 1;
+        }
+        event.events = EPOLLIN;
+        event.data.fd = scan.done_fds[0];
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, scan.done_fds[0], &event);
+        open_query_socket(&queries, epoll_fd);
+    }
+
+    bool interactive = !opt_daemon && opt_format == FORMAT_TEXT && !opt_output && isatty(STDOUT_FILENO);
+    screen_t screen = {0};
+    screen.interactive = interactive;
+    screen.rows = interactive ? get_terminal_height() : INT_MAX;
+    layout_t layout = compute_layout(get_terminal_width());
+
+    // Alternate screen without cursor, like watch(1)
+    if (interactive)
+        fputs("\033[?1049h\033[?25l", stdout);
+    fflush(stdout);
+
+    // The daemon's first scan runs before any query is answered, so no
+    // client sees an empty table
+    if (opt_daemon)
+    {
+        rescan_drives(&drives, &mounts);
+        index_query_drives(&queries, &drives);
+        publish_snapshot(&snapshot_writer, &drives);
+    }
+    else
+    {
+        watch_refresh(&drives, &mounts, true, &screen, &layout, true);
+    }
+
+    bool running = true;
+    while (running)
+    {
+        struct epoll_event events[WATCH_MAX_EVENTS];
+        int ready = epoll_wait(epoll_fd, events, WATCH_MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < ready; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == queries.listen_fd)
+            {
+                accept_query_clients(&queries, epoll_fd);
+            }
+            else if (find_query_client(&queries, fd))
+            {
+                serve_query_client(&queries, fd, events[i].events, epoll_fd, &drives);
+            }
+            else if (fd == scan.done_fds[0])
+            {
+                finish_daemon_scan(&scan, &drives, &queries);
+            }
+            else if (events[i].data.fd == timer_fd)
+            {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations))
+                    continue;
+                if (opt_daemon)
+                {
+                    scan.mounts_changed |= !mounts_notify;
+                    start_daemon_scan(&scan);
+                    continue;
+                }
+                mounts.stale |= !mounts_notify;
+                watch_refresh(&drives, &mounts, true, &screen, &layout, false);
+            }
+            else if (events[i].data.fd == mounts_fd)
+            {
+                if (opt_daemon)
+                {
+                    scan.mounts_changed = true;
+                    start_daemon_scan(&scan);
+                    continue;
+                }
+                mounts.stale = true;
+                watch_refresh(&drives, &mounts, true, &screen, &layout, false);
+            }
+            else if (events[i].data.fd == signal_fd)
+            {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) != (ssize_t)sizeof(info))
+                    continue;
+                if (info.ssi_signo == SIGWINCH && !opt_daemon)
+                {
+                    layout = compute_layout(get_terminal_width());
+                    if (interactive)
+                        screen.rows = get_terminal_height();
+                    watch_refresh(&drives, &mounts, false, &screen, &layout, true);
+                }
+                else if (info.ssi_signo != SIGWINCH)
                 {
-                    strncpy(uuid, entry->d_name, uuid_size - 1);
-                    uuid[uuid_size - 1] = '\0';
-                    break;
+                    running = false;
                 }
             }
         }
-        closedir(uuid_dir);
     }
 
-    // Label suchen
-    DIR *label_dir = opendir("/dev/disk/by-label/");
-    if (label_dir)
+    if (interactive)
+        fputs("\033[?25h\033[?1049l", stdout);
+    fflush(stdout);
+
+    if (opt_daemon)
     {
-        struct dirent *entry;
-        char full_path[PATH_MAX];
-        char resolved_link[PATH_MAX];
-        while ((entry = readdir(label_dir)) != NULL)
-        {
-            if (entry->d_name[0] == '.')
-                continue;
-            snprintf(full_path, sizeof(full_path), "/dev/disk/by-label/%s", entry->d_name);
-            if (realpath(full_path, resolved_link))
-            {
-                if (strcmp(resolved_link, resolved_device) == 0)
-                {
-                    strncpy(label, entry->d_name, label_size - 1);
-                    label[label_size - 1] = '\0';
-                    break;
-                }
-            }
-        }
-        closedir(label_dir);
+        // Withdraw first, so readers do not wait for a scan that is running;
+        // it ends within its timeouts
+        close_query_socket(&queries);
+        close_snapshot(&snapshot_writer);
+        if (scan.running)
+            pthread_join(scan.thread, NULL);
+        close(scan.done_fds[0]);
+        close(scan.done_fds[1]);
+        free_drive_table(&scan.table);
     }
+    free_mount_jobs(mounts.jobs, mounts.job_count);
+    free(mounts.seen_ids);
+    free(mounts.reported_ids);
+    free(screen.lines);
+    free(screen.text);
+    free_drive_table(&drives);
+    if (mounts_fd >= 0)
+        close(mounts_fd);
+    close(epoll_fd);
+    close(timer_fd);
+    close(signal_fd);
+    return 0;
 }
 
-// Helper function: Query SMART status (only for root and physical devices)
-void get_smart_status(const char *device, char *status, size_t status_size)
+// Function to order mounts by mount point, then device
+int compare_mount_jobs(const void *a, const void *b)
 {
-    status[0] = '\0';
-    if (geteuid() != 0)
-        return;
-    // Allow all /dev/sd*, /dev/nvme*, /dev/hd* (including partitions)
-    if (!(
-            strncmp(device, "/dev/sd", 7) == 0 ||
-            strncmp(device, "/dev/nvme", 9) == 0 ||
-            strncmp(device, "/dev/hd", 7) == 0))
-        return;
+    const probe_job_t *job_a = (const probe_job_t *)a;
+    const probe_job_t *job_b = (const probe_job_t *)b;
+    int cmp = strcmp(job_a->mount_point, job_b->mount_point);
+    return cmp ? cmp : strcmp(job_a->device, job_b->device);
+}
 
-    char cmd[256], line[256];
-    snprintf(cmd, sizeof(cmd), "smartctl -H %s 2>/dev/null", device);
-    FILE *fp = popen(cmd, "r");
-    if (!fp)
-        return;
-    while (fgets(line, sizeof(line), fp))
+// Function to append one mount event as a JSON line
+void render_mount_event(strbuf_t *out, const char *event, const probe_job_t *job, const char *previous_options)
+{
+    char stamp[MAX_SIZE_STR_LENGTH];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    strbuf_append_str(out, "{\"event\": ");
+    json_append_string(out, event);
+    strbuf_append_str(out, ", \"time\": ");
+    json_append_string(out, stamp);
+    strbuf_append_str(out, ", \"mount_point\": ");
+    json_append_string(out, job->mount_point);
+    strbuf_append_str(out, ", \"device\": ");
+    json_append_string(out, job->device);
+    strbuf_append_str(out, ", \"filesystem\": ");
+    json_append_string(out, job->filesystem);
+    strbuf_append_str(out, ", \"mount_options\": ");
+    json_append_string(out, job->mount_options);
+    if (previous_options)
     {
-        if (strstr(line, "SMART overall-health self-assessment test result") || strstr(line, "SMART Health Status"))
-        {
-            char *p = strchr(line, ':');
-            if (p)
-            {
-                p++;
-                while (*p == ' ' || *p == '\t')
-                    p++;
-                strncpy(status, p, status_size - 1);
-                status[status_size - 1] = '\0';
-                char *nl = strchr(status, '\n');
-                if (nl)
-                    *nl = '\0';
-                break;
-            }
-        }
-        if (strstr(line, "PASSED"))
-        {
-            strncpy(status, "PASSED", status_size - 1);
-            status[status_size - 1] = '\0';
-            break;
-        }
-        if (strstr(line, "FAILED"))
+        strbuf_append_str(out, ", \"previous_options\": ");
+        json_append_string(out, previous_options);
+    }
+    strbuf_append_str(out, "}\n");
+}
+
+// Function to emit mount, unmount and remount events between two sorted
+// mount lists, all lines of one change in a single write
+void diff_mount_tables(const probe_job_t *old_jobs, int old_count, const probe_job_t *new_jobs, int new_count)
+{
+    strbuf_t out = {0};
+    int i = 0, j = 0;
+    while (i < old_count || j < new_count)
+    {
+        int cmp = i >= old_count ? 1 : j >= new_count ? -1 : compare_mount_jobs(&old_jobs[i], &new_jobs[j]);
+        if (cmp < 0)
         {
-            strncpy(status, "FAILED", status_size - 1);
-            status[status_size - 1] = '\0';
-            break;
+            render_mount_event(&out, "unmount", &old_jobs[i++], NULL);
         }
-        if (strstr(line, "UNKNOWN"))
+        else if (cmp > 0)
         {
-            strncpy(status, "UNKNOWN", status_size - 1);
-            status[status_size - 1] = '\0';
-            break;
+            render_mount_event(&out, "mount", &new_jobs[j++], NULL);
         }
-        if (strstr(line, "NOT AVAILABLE"))
+        else
         {
-            strncpy(status, "NOT AVAILABLE", status_size - 1);
-            status[status_size - 1] = '\0';
-            break;
+            if (strcmp(old_jobs[i].mount_options, new_jobs[j].mount_options) != 0)
+                render_mount_event(&out, "remount", &new_jobs[j], old_jobs[i].mount_options);
+            i++;
+            j++;
         }
     }
-    pclose(fp);
+    if (out.length > 0 || out.failed)
+        strbuf_write_stdout(&out);
+    strbuf_free(&out);
 }
 
-void print_json(drive_info_t *drives, int count) {
-    printf("[\n");
-    for (int i = 0; i < count; i++) {
-        drive_info_t *d = &drives[i];
-        printf("  {\n");
-        printf("    \"device\": \"%s\",\n", d->device);
-        printf("    \"mount_point\": \"%s\",\n", d->mount_point);
-        printf("    \"filesystem\": \"%s\",\n", d->filesystem);
-        printf("    \"total_bytes\": %llu,\n", d->total_bytes);
-        printf("    \"used_bytes\": %llu,\n", d->used_bytes);
-        printf("    \"available_bytes\": %llu,\n", d->available_bytes);
-        printf("    \"usage_percent\": %.1f,\n", d->usage_percent);
-        printf("    \"type\": \"%s\",\n", d->drive_type);
-        printf("    \"is_cloud\": %s,\n", d->is_cloud_storage ? "true" : "false");
-        printf("    \"cloud_service\": \"%s\",\n", d->cloud_service_name);
-        printf("    \"uuid\": \"%s\",\n", d->uuid);
-        printf("    \"label\": \"%s\",\n", d->label);
-        printf("    \"mount_options\": \"%s\",\n", d->mount_options);
-        printf("    \"total_inodes\": %llu,\n", d->total_inodes);
-        printf("    \"used_inodes\": %llu,\n", d->used_inodes);
-        printf("    \"inode_usage\": %.1f\n", d->inode_usage);
-        if (i < count - 1) printf("  },\n");
-        else printf("  }\n");
-    }
-    printf("]\n");
-}
-
-void discover_drives(drive_info_t *drives, int *drive_count) {
-    *drive_count = 0;
-
-    // Open the mount table
-    FILE *mtab = setmntent(MOUNT_TABLE_PATH, "r");
-    if (mtab == NULL)
+// Function to stream mount table changes as NDJSON until interrupted. The
+// table is only reread when the kernel flags it with POLLPRI.
+int run_events()
+{
+    char mounts_path[MAX_ROOTED_PATH_LENGTH];
+    int mounts_fd = open(mount_table_path(mounts_path, sizeof(mounts_path)), O_RDONLY | O_CLOEXEC);
+    if (mounts_fd < 0)
     {
         perror("Error opening mount table");
-        return;
+        return 1;
     }
 
-    struct mntent *entry;
-
-    // Loop through all mount points and collect drive information
-    while ((entry = getmntent(mtab)) != NULL && *drive_count < MAX_DRIVES)
+    probe_job_t *current;
+    int current_count;
+    if (!collect_mount_jobs(&current, &current_count, false))
     {
-        // Skip special file systems
-        const int skip_count = sizeof(skip_filesystems) / sizeof(skip_filesystems[0]);
+        close(mounts_fd);
+        return 1;
+    }
+    qsort(current, current_count, sizeof(probe_job_t), compare_mount_jobs);
 
-        bool should_skip = false;
-        for (int i = 0; i < skip_count; i++)
+    struct pollfd pfd = {.fd = mounts_fd, .events = POLLPRI};
+    for (;;)
+    {
+        if (poll(&pfd, 1, -1) < 0)
         {
-            if (strcmp(entry->mnt_type, skip_filesystems[i]) == 0)
-            {
-                should_skip = true;
-                break;
-            }
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
         }
-
-        if (should_skip)
-        {
+        if (!(pfd.revents & (POLLPRI | POLLERR)))
             continue;
-        }
 
-        // Show physical drives and network drives
-        if (!is_physical_device(entry->mnt_fsname) &&
-            !is_network_device(entry->mnt_fsname) &&
-            !is_network_filesystem(entry->mnt_type))
-        {
-            continue;
-        }
+        probe_job_t *updated;
+        int updated_count;
+        if (!collect_mount_jobs(&updated, &updated_count, false))
+            break;
+        qsort(updated, updated_count, sizeof(probe_job_t), compare_mount_jobs);
+        diff_mount_tables(current, current_count, updated, updated_count);
+        free(current);
+        current = updated;
+        current_count = updated_count;
+    }
 
-        // Skip AppImages and temporary mounts
-        if (is_appimage_or_temp(entry->mnt_fsname, entry->mnt_dir))
-        {
-            continue;
-        }
+    free(current);
+    close(mounts_fd);
+    return 1;
+}
 
-        // Get file system information
-        struct statvfs fs_info;
-        if (statvfs(entry->mnt_dir, &fs_info) != 0)
-        {
-            continue; // Skip if no information available
-        }
+// Helper: print a drive as a JSON line as soon as its probe is finished.
+// context is the ndjson_state_t of run_ndjson(), whose one-row table and
+// line buffer are reused for every drive.
+void print_probed_drive(const probe_job_t *job, int index, void *context)
+{
+    (void)index;
+    ndjson_state_t *state = (ndjson_state_t *)context;
+    drive_table_t *table = &state->table;
+    if (job->state != PROBE_DONE && job->state != PROBE_TIMEOUT)
+        return;
 
-        // Calculate sizes
-        unsigned long long total_bytes = (unsigned long long)fs_info.f_blocks * fs_info.f_frsize;
-        unsigned long long available_bytes = (unsigned long long)fs_info.f_bavail * fs_info.f_frsize;
-        unsigned long long used_bytes = total_bytes - available_bytes;
+    clear_drive_table(table);
+    if (!add_probed_drive(table, job) || !where_accepts_drive(table, 0))
+        return;
+    collect_smart_info(table);
 
-        // Format sizes for output
-        char total_str[MAX_SIZE_STR_LENGTH], used_str[MAX_SIZE_STR_LENGTH], available_str[MAX_SIZE_STR_LENGTH];
-        format_bytes(total_bytes, total_str, sizeof(total_str));
-        format_bytes(used_bytes, used_str, sizeof(used_str));
-        format_bytes(available_bytes, available_str, sizeof(available_str));
+    strbuf_reset(&state->line);
+    strbuf_append(&state->line, "{", 1);
+    render_json_drive(&state->line, table, 0, NULL, opt_fields);
+    strbuf_append(&state->line, "}\n", 2);
+    strbuf_write_stdout(&state->line);
+}
 
-        // Inode-Infos
-        unsigned long long total_inodes = fs_info.f_files;
-        unsigned long long free_inodes = fs_info.f_favail;
-        unsigned long long used_inodes = total_inodes > 0 ? total_inodes - free_inodes : 0;
-        double inode_usage = (total_inodes > 0) ? ((double)used_inodes / total_inodes) * 100.0 : 0.0;
-
-        // Target width: 80% of terminal width or max. 120 characters
-        int terminal_width = get_terminal_width();
-        int box_width = terminal_width * TERMINAL_WIDTH_PERCENTAGE / TERMINAL_WIDTH_DIVISOR;
-        if (box_width > MAX_BOX_WIDTH)
-            box_width = MAX_BOX_WIDTH;
-        if (box_width < MIN_BOX_WIDTH)
-            box_width = MIN_BOX_WIDTH;
-        int content_width = box_width - FRAME_PADDING;    // for frame
-        int bar_length = content_width - BRACKET_PADDING; // for [ and ]
-        if (bar_length < MIN_BAR_LENGTH)
-            bar_length = MIN_BAR_LENGTH;
-
-        // Calculate usage
-        double usage_percent = calculate_usage_percent(total_bytes, available_bytes);
-        int filled_length = (int)((usage_percent / USAGE_PERCENT_DIVISOR) * bar_length);
-        char percent_text[MAX_PERCENT_TEXT_LENGTH];
-        snprintf(percent_text, sizeof(percent_text), PERCENT_FORMAT, usage_percent);
-        int text_length = strlen(percent_text);
-        int text_start = filled_length > text_length ? (filled_length - text_length) / 2 : 0;
-
-        // Dynamically allocate progress bar
-        size_t bar_bufsize = bar_length * MAX_BAR_BUFFER_MULTIPLIER + 1;
-        char *bar = malloc(bar_bufsize);
-        if (!bar)
+// Function to stream one JSON line per drive in the order the probes
+// finish. Nothing is kept once a line is written, so memory does not grow
+// with the number of drives.
+int run_ndjson()
+{
+    probe_job_t *jobs;
+    int job_count;
+    if (!collect_mount_jobs(&jobs, &job_count, true))
+        return 1;
+    group_mount_jobs(jobs, &job_count);
+
+    ndjson_state_t state = {0};
+    probe_job_t *results = run_probes(jobs, job_count, print_probed_drive, &state);
+    bool ok = results != NULL;
+    free(results);
+    free_drive_table(&state.table);
+    strbuf_free(&state.line);
+    free_mount_jobs(jobs, job_count);
+    return ok ? 0 : 1;
+}
+
+// Helper: append a copy of a path to a growable list
+bool add_path(char ***paths, int *count, int *capacity, const char *path)
+{
+    if (*count == *capacity)
+    {
+        int grown_capacity = *capacity ? *capacity * 2 : 16;
+        char **grown = realloc(*paths, (size_t)grown_capacity * sizeof(char *));
+        if (!grown)
+            return false;
+        *paths = grown;
+        *capacity = grown_capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy)
+        return false;
+    (*paths)[(*count)++] = copy;
+    return true;
+}
+
+// Function to add the paths listed in a file (one per line, "-" = stdin)
+bool read_path_list(const char *file, char ***paths, int *count, int *capacity)
+{
+    FILE *fp = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (!fp)
+    {
+        perror(file);
+        return false;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t length;
+    bool ok = true;
+    while (ok && (length = getline(&line, &line_size, fp)) >= 0)
+    {
+        if (length > 0 && line[length - 1] == '\n')
+            line[--length] = '\0';
+        if (length > 0)
+            ok = add_path(paths, count, capacity, line);
+    }
+    free(line);
+    if (fp != stdin)
+        fclose(fp);
+    if (!ok)
+        perror("malloc");
+    return ok;
+}
+
+// Function to report the filesystem holding each path, like df PATH. The
+// mount table is read once; each path is resolved through the mount trie
+// and checked against its st_dev, and every filesystem is probed once no
+// matter how many paths it holds. Returns 1 if a path could not be resolved.
+int run_paths(char **paths, int path_count)
+{
+    mount_table_t table;
+    if (!read_mount_table(&table, NULL, 0))
+    {
+        perror("Error reading mount table");
+        return 1;
+    }
+    mount_trie_t trie;
+    int *path_job = malloc((size_t)(path_count ? path_count : 1) * sizeof(int));
+    int *mount_job = malloc((size_t)(table.count ? table.count : 1) * sizeof(int));
+    if (!build_mount_trie(&trie, &table) || !path_job || !mount_job)
+    {
+        perror("malloc");
+        free_mount_trie(&trie);
+        free(path_job);
+        free(mount_job);
+        free_mount_table(&table);
+        return 1;
+    }
+    for (int i = 0; i < table.count; i++)
+        mount_job[i] = -1;
+
+    int status = 0;
+    probe_job_t *jobs = NULL;
+    int job_count = 0, job_capacity = 0;
+    size_t root_length = strlen(system_root);
+    for (int p = 0; p < path_count; p++)
+    {
+        path_job[p] = -1;
+        char rooted[MAX_ROOTED_PATH_LENGTH], resolved[PATH_MAX];
+        struct stat st;
+        if (!realpath(rooted_path(paths[p], rooted, sizeof(rooted)), resolved) || stat(resolved, &st) != 0)
         {
-            perror("malloc");
+            fprintf(stderr, "%s: %s\n", paths[p], strerror(errno));
+            status = 1;
             continue;
         }
-        bar[0] = '\0';
-        for (int i = 0; i < bar_length; i++)
-        {
-            if (i >= text_start && i < text_start + text_length && i < filled_length)
-            {
-                if (!opt_no_color) {
-                    get_bar_color(i, bar_length, colorbuf, sizeof(colorbuf));
-                    int r, g, b;
-                    sscanf(colorbuf, COLOR_FORMAT, &r, &g, &b);
-                    char tmp[MAX_TEMP_BUFFER_LENGTH];
-                    snprintf(tmp, sizeof(tmp), BACKGROUND_COLOR_FORMAT BLUE_TEXT_FORMAT "%c" RESET_FORMAT, r, g, b, BLUE_TEXT_R, BLUE_TEXT_G, BLUE_TEXT_B, percent_text[i - text_start]);
-                    strncat(bar, tmp, bar_bufsize - strlen(bar) - 1);
-                } else {
-                    char tmp[2] = {percent_text[i - text_start], '\0'};
-                    strncat(bar, tmp, bar_bufsize - strlen(bar) - 1);
-                }
-            }
-            else if (i < filled_length)
-            {
-                if (!opt_no_color) {
-                    get_bar_color(i, bar_length, colorbuf, sizeof(colorbuf));
-                    strncat(bar, colorbuf, bar_bufsize - strlen(bar) - 1);
-                    strncat(bar, "█" RESET_FORMAT, bar_bufsize - strlen(bar) - 1);
-                } else {
-                    strncat(bar, "█", bar_bufsize - strlen(bar) - 1);
-                }
-            }
-            else
-            {
-                if (!opt_no_color) {
-                    strncat(bar, "\033[48;2;64;64;64m\033[38;2;160;160;160m░\033[0m", bar_bufsize - strlen(bar) - 1);
-                } else {
-                    strncat(bar, "░", bar_bufsize - strlen(bar) - 1);
-                }
-            }
-        }
 
-        // Determine drive type
-        const char *drive_type;
-        if (is_physical_device(entry->mnt_fsname))
+        // Mount points are in the namespace below --root
+        const char *path = resolved;
+        if (root_length && strncmp(resolved, system_root, root_length) == 0)
+            path = resolved[root_length] ? resolved + root_length : "/";
+
+        int mount = mount_trie_lookup(&trie, path);
+        const mount_entry_t *entry = mount >= 0 ? &table.entries[mount] : NULL;
+        if (!entry || makedev(entry->major, entry->minor) != st.st_dev)
         {
-            drive_type = "Local Drive";
+            int by_dev = find_mount_by_dev(&table, path, st.st_dev);
+            if (by_dev >= 0)
+                mount = by_dev;
         }
-        else if (is_network_filesystem(entry->mnt_type) || is_network_device(entry->mnt_fsname))
+        if (mount < 0)
         {
-            drive_type = "Network Drive";
+            fprintf(stderr, "%s: no filesystem found\n", paths[p]);
+            status = 1;
+            continue;
         }
-        else
+
+        if (mount_job[mount] < 0)
         {
-            drive_type = "Other Drive";
+            probe_job_t *job = add_probe_job(&jobs, &job_count, &job_capacity);
+            if (!job)
+                break;
+            fill_mount_job(job, &table.entries[mount]);
+            mount_job[mount] = job_count - 1;
         }
-
-        // UUID und Label ermitteln
-        char uuid[128], label[128];
-        get_uuid_and_label(entry->mnt_fsname, uuid, sizeof(uuid), label, sizeof(label));
-
-        // Store information in drive_info_t structure
-        drive_info_t *drive = &drives[*drive_count];
-        fill_drive_info(drive, entry->mnt_dir, entry->mnt_type, entry->mnt_fsname,
-                        uuid, label,
-                        total_str, used_str, available_str,
-                        total_bytes, used_bytes, available_bytes,
-                        usage_percent, drive_type, bar, false, NULL, entry->mnt_opts,
-                        total_inodes, used_inodes, inode_usage);
-
-        (*drive_count)++;
+        path_job[p] = mount_job[mount];
     }
+    free_mount_trie(&trie);
+    free(mount_job);
+    free_mount_table(&table);
 
-    endmntent(mtab);
-
-    // Check for GVFS-based cloud storage
-    char gvfs_path[MAX_GVFS_PATH_LENGTH];
-    snprintf(gvfs_path, sizeof(gvfs_path), GVFS_BASE_PATH, getuid());
-    if (is_cloud_storage_directory(gvfs_path))
+    drive_table_t drives = {0};
+    probe_job_t *results = run_probes(jobs, job_count, NULL, NULL);
+    for (int p = 0; results && p < path_count; p++)
     {
-        get_cloud_storage_info(gvfs_path, drives, drive_count);
+        if (path_job[p] < 0)
+            continue;
+        const probe_job_t *result = &results[path_job[p]];
+        record_probe_latency(result);
+        if (result->state != PROBE_DONE && result->state != PROBE_TIMEOUT)
+        {
+            fprintf(stderr, "%s: cannot read filesystem statistics of %s\n", paths[p], result->mount_point);
+            status = 1;
+            continue;
+        }
+        if (!add_probed_drive(&drives, result))
+            break;
+        drives.info[drives.count - 1].path = arena_strdup(&drives.strings, paths[p]);
+        if (!where_accepts_drive(&drives, drives.count - 1))
+            drives.count--;
+    }
+    collect_smart_info(&drives);
+
+    // Paths are reported in the order they were given
+    if (opt_format != FORMAT_TEXT) {
+        print_document(&drives);
+    } else {
+        strbuf_t report = {0};
+        layout_t layout = compute_layout(get_terminal_width());
+        render_text_report(&report, &drives, &layout);
+        write_output(&report);
+        strbuf_free(&report);
     }
+
+    free(results);
+    free(path_job);
+    free_mount_jobs(jobs, job_count);
+    free_drive_table(&drives);
+    return results && !output_failed ? status : 1;
 }
 
 int main(int argc, char *argv[])
@@ -907,15 +7306,39 @@ int main(int argc, char *argv[])
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
         {"json", no_argument, 0, 'j'},
+        {"format", required_argument, 0, 'o'},
+        {"output", required_argument, 0, 'O'},
+        {"daemon", no_argument, 0, 'A'},
+        {"snapshot", required_argument, 0, 'S'},
+        {"no-snapshot", no_argument, 0, 'G'},
+        {"socket", required_argument, 0, 'U'},
+        {"socket-mode", required_argument, 0, 'M'},
+        {"socket-group", required_argument, 0, 'Y'},
         {"no-color", no_argument, 0, 'n'},
         {"sort", required_argument, 0, 's'},
+        {"timeout", required_argument, 0, 't'},
+        {"deadline", required_argument, 0, 'd'},
+        {"isolate", optional_argument, 0, 'i'},
+        {"identify", required_argument, 0, 'I'},
+        {"smart-ttl", required_argument, 0, 'T'},
+        {"no-dedup", no_argument, 0, 'D'},
+        {"ndjson", no_argument, 0, 'N'},
+        {"root", required_argument, 0, 'R'},
+        {"profile", no_argument, 0, 'P'},
+        {"fields", required_argument, 0, 'F'},
+        {"where", required_argument, 0, 'W'},
+        {"exclude-type", required_argument, 0, 'X'},
+        {"paths-from", required_argument, 0, 'p'},
+        {"top", required_argument, 0, 'K'},
+        {"watch", required_argument, 0, 'w'},
+        {"events", no_argument, 0, 'e'},
         {0, 0, 0, 0}
     };
 
     int opt;
     int option_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "hvjns:", long_options, &option_index)) != -1)
+    while ((opt = getopt_long(argc, argv, "hvjns:t:d:i::I:w:e", long_options, &option_index)) != -1)
     {
         switch (opt)
         {
@@ -926,126 +7349,311 @@ int main(int argc, char *argv[])
             show_version();
             return 0;
         case 'j':
-            opt_json = true;
+            opt_format = FORMAT_JSON;
+            break;
+        case 'o':
+            if (strcmp(optarg, "text") == 0) opt_format = FORMAT_TEXT;
+            else if (strcmp(optarg, "json") == 0) opt_format = FORMAT_JSON;
+            else if (strcmp(optarg, "cbor") == 0) opt_format = FORMAT_CBOR;
+            else if (strcmp(optarg, "msgpack") == 0) opt_format = FORMAT_MSGPACK;
+            else if (strcmp(optarg, "prometheus") == 0) opt_format = FORMAT_PROMETHEUS;
+            else {
+                fprintf(stderr, "Invalid format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'O':
+            opt_output = optarg;
+            break;
+        case 'A':
+            opt_daemon = true;
             break;
+        case 'S':
+            opt_snapshot = optarg;
+            break;
+        case 'G':
+            opt_no_snapshot = true;
+            break;
+        case 'U':
+            opt_socket = optarg;
+            break;
+        case 'M':
+        {
+            char *end;
+            errno = 0;
+            long mode = strtol(optarg, &end, 8);
+            if (errno != 0 || *end != '\0' || end == optarg || mode < 0 || mode > 0777)
+            {
+                fprintf(stderr, "Invalid socket mode: %s\n", optarg);
+                return 1;
+            }
+            opt_socket_mode = (mode_t)mode;
+            break;
+        }
+        case 'Y':
+        {
+            struct group *group = getgrnam(optarg);
+            char *end;
+            long gid = group ? (long)group->gr_gid : strtol(optarg, &end, 10);
+            if (!group && (*end != '\0' || end == optarg || gid < 0))
+            {
+                fprintf(stderr, "Invalid socket group: %s\n", optarg);
+                return 1;
+            }
+            opt_socket_group = (gid_t)gid;
+            break;
+        }
         case 'n':
             opt_no_color = true;
             break;
-        case 's':
-            if (strcmp(optarg, "size") == 0) opt_sort = SORT_SIZE;
-            else if (strcmp(optarg, "usage") == 0) opt_sort = SORT_USAGE;
-            else if (strcmp(optarg, "mount") == 0) opt_sort = SORT_MOUNT;
-            else if (strcmp(optarg, "name") == 0) opt_sort = SORT_NAME;
+        case 's': {
+            char *list = optarg;
+            char *key;
+            opt_sort_key_count = 0;
+            while ((key = strsep(&list, ",")) != NULL) {
+                bool reverse = key[0] == '-';
+                if (reverse) key++;
+                sort_field_t field;
+                if (strcmp(key, "size") == 0) field = SORT_SIZE;
+                else if (strcmp(key, "usage") == 0) field = SORT_USAGE;
+                else if (strcmp(key, "mount") == 0) field = SORT_MOUNT;
+                else if (strcmp(key, "name") == 0) field = SORT_NAME;
+                else {
+                    fprintf(stderr, "Invalid sort option: %s\n", key);
+                    return 1;
+                }
+                if (opt_sort_key_count == MAX_SORT_KEYS) {
+                    fprintf(stderr, "Invalid sort option: too many keys\n");
+                    return 1;
+                }
+                opt_sort_keys[opt_sort_key_count++] = (sort_key_t){field, reverse};
+            }
+            break;
+        }
+        case 'K':
+        {
+            char *end;
+            errno = 0;
+            long top = strtol(optarg, &end, 10);
+            if (errno != 0 || *end != '\0' || end == optarg || top < 1 || top > INT_MAX)
+            {
+                fprintf(stderr, "Invalid top count: %s\n", optarg);
+                return 1;
+            }
+            opt_top = (int)top;
+            break;
+        }
+        case 'I':
+            return identify_filesystem(optarg);
+        case 'i':
+            if (!optarg || strcmp(optarg, "network") == 0) opt_isolate = ISOLATE_NETWORK;
+            else if (strcmp(optarg, "all") == 0) opt_isolate = ISOLATE_ALL;
             else {
-                fprintf(stderr, "Invalid sort option: %s\n", optarg);
+                fprintf(stderr, "Invalid isolate option: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'e':
+            opt_events = true;
+            break;
+        case 'w':
+        {
+            char *end;
+            errno = 0;
+            long seconds = strtol(optarg, &end, 10);
+            if (errno != 0 || *end != '\0' || end == optarg || seconds < 1 || seconds > INT_MAX)
+            {
+                fprintf(stderr, "Invalid watch interval: %s\n", optarg);
+                return 1;
+            }
+            opt_watch_seconds = (int)seconds;
+            break;
+        }
+        case 'D':
+            opt_no_dedup = true;
+            break;
+        case 'N':
+            opt_ndjson = true;
+            break;
+        case 'P':
+            opt_profile = true;
+            break;
+        case 'p':
+            opt_paths_from = optarg;
+            break;
+        case 'W':
+        {
+            const char *error_at;
+            const char *error = where_compile(&where_program, optarg, &error_at);
+            if (error)
+            {
+                if (*error_at)
+                    fprintf(stderr, "Invalid where expression: %s at '%s'\n", error, error_at);
+                else
+                    fprintf(stderr, "Invalid where expression: %s\n", error);
+                return 1;
+            }
+            break;
+        }
+        case 'X':
+            if (!where_exclude_types(&where_program, optarg))
+            {
+                perror("malloc");
+                return 1;
+            }
+            break;
+        case 'F':
+        {
+            const char *bad = parse_field_list(optarg, &opt_fields);
+            if (bad)
+            {
+                fprintf(stderr, "Invalid field: %s\n", bad);
+                return 1;
+            }
+            break;
+        }
+        case 'R':
+        {
+            // Canonical and without a trailing slash, so prefixes compare
+            // with resolved paths; "/" is the same as no root
+            char resolved[PATH_MAX];
+            struct stat st;
+            if (!realpath(optarg, resolved) || strlen(resolved) >= sizeof(system_root) ||
+                stat(resolved, &st) != 0 || !S_ISDIR(st.st_mode))
+            {
+                fprintf(stderr, "Invalid root: %s\n", optarg);
+                return 1;
+            }
+            snprintf(system_root, sizeof(system_root), "%s", strcmp(resolved, "/") == 0 ? "" : resolved);
+            break;
+        }
+        case 'T':
+        {
+            char *end;
+            errno = 0;
+            long ttl = strtol(optarg, &end, 10);
+            if (errno != 0 || *end != '\0' || end == optarg || ttl < 0 || ttl > INT_MAX)
+            {
+                fprintf(stderr, "Invalid SMART TTL: %s\n", optarg);
+                return 1;
+            }
+            opt_smart_ttl = (int)ttl;
+            break;
+        }
+        case 't':
+        case 'd':
+        {
+            char *end;
+            errno = 0;
+            long ms = strtol(optarg, &end, 10);
+            if (errno != 0 || *end != '\0' || end == optarg || ms < 0 || ms > INT_MAX)
+            {
+                fprintf(stderr, "Invalid %s value: %s\n", opt == 't' ? "timeout" : "deadline", optarg);
                 return 1;
             }
+            if (opt == 't')
+                opt_timeout_ms = (int)ms;
+            else
+                opt_deadline_ms = (int)ms;
             break;
+        }
         default:
             return 1;
         }
     }
 
+    if (opt_output && (opt_ndjson || opt_events)) {
+        fprintf(stderr, "Invalid option: --output needs a complete report, not --ndjson or --events\n");
+        return 1;
+    }
+
     if (opt_no_color) {
         c_bold_yellow = "";
         c_reset = "";
     }
 
-    if (!opt_json) {
-        printf("\n");
+    if (opt_daemon)
+    {
+        if (opt_watch_seconds == 0)
+            opt_watch_seconds = DEFAULT_DAEMON_INTERVAL;
+        if (snapshot_scope() != 0)
+            fprintf(stderr, "Warning: --where, --exclude-type, --top, --root and --no-dedup narrow the snapshot; "
+                            "plain drinfo runs will scan instead of reading it\n");
+        return run_watch();
     }
+    if (optind < argc || opt_paths_from)
+    {
+        char **paths = NULL;
+        int path_count = 0, path_capacity = 0;
+        bool ok = true;
+        for (int i = optind; ok && i < argc; i++)
+            ok = add_path(&paths, &path_count, &path_capacity, argv[i]);
+        if (!ok)
+            perror("malloc");
+        else if (opt_paths_from)
+            ok = read_path_list(opt_paths_from, &paths, &path_count, &path_capacity);
+        int status = ok ? run_paths(paths, path_count) : 1;
+        for (int i = 0; i < path_count; i++)
+            free(paths[i]);
+        free(paths);
+        return status;
+    }
+    if (opt_events)
+        return run_events();
+    if (opt_ndjson)
+        return run_ndjson();
+    if (opt_watch_seconds > 0)
+        return run_watch();
 
-    // Array to store all drive information
-    drive_info_t drives[MAX_DRIVES];
-    int drive_count = 0;
-
-    discover_drives(drives, &drive_count);
-
-    // Sort drives
-    switch (opt_sort) {
-        case SORT_SIZE:
-            qsort(drives, drive_count, sizeof(drive_info_t), compare_drives_by_capacity);
-            break;
-        case SORT_USAGE:
-            qsort(drives, drive_count, sizeof(drive_info_t), compare_drives_by_usage);
-            break;
-        case SORT_MOUNT:
-            qsort(drives, drive_count, sizeof(drive_info_t), compare_drives_by_mount);
-            break;
-        case SORT_NAME:
-            qsort(drives, drive_count, sizeof(drive_info_t), compare_drives_by_name);
-            break;
+    if (opt_format == FORMAT_TEXT && !opt_output) {
+        printf("\n");
     }
 
-    if (opt_json) {
-        print_json(drives, drive_count);
-    } else {
-        // Display sorted drives
-        for (int i = 0; i < drive_count; i++)
-        {
-            drive_info_t *drive = &drives[i];
+    if (opt_profile)
+        profile_start();
 
-            // Display drive information
-            if (drive->is_cloud_storage)
-            {
-                printf("  %sNetwork Drive %d (%s)%s\n", c_bold_yellow, i + 1, drive->cloud_service_name, c_reset);
-            }
-            else
-            {
-                printf("  %s%s %d%s\n", c_bold_yellow, drive->drive_type, i + 1, c_reset);
-            }
-            printf("  Mount point:   %s\n", drive->mount_point);
-            printf("  Filesystem:    %s\n", drive->filesystem);
-            printf("  Device:        %s\n", drive->device);
-            printf("  UUID:          %s\n", drive->uuid[0] ? drive->uuid : "-");
-            printf("  Label:         %s\n", drive->label[0] ? drive->label : "-");
-            printf("  Mount options: %s\n", drive->mount_options);
-            printf("  Total size:    %s\n", drive->total_str);
-            printf("  Used:          %s\n", drive->used_str);
-            printf("  Available:     %s\n", drive->available_str);
-            printf("  Inodes:        %llu/%llu (%.1f%% used)\n", drive->used_inodes, drive->total_inodes, drive->inode_usage);
-
-            // SMART status only for root and physical devices
-            if (geteuid() == 0 && !drive->is_cloud_storage && strcmp(drive->drive_type, "Local Drive") == 0)
-            {
-                char smart_status[128];
-                get_smart_status(drive->device, smart_status, sizeof(smart_status));
-                if (smart_status[0])
-                {
-                    printf("  SMART:         %s\n", smart_status);
-                }
-                else
-                {
-                    printf("  SMART:         No data\n");
-                }
-            }
+    // Table to store all drive information
+    drive_table_t drives = {0};
 
-            // Progress bar
-            int terminal_width = get_terminal_width();
-            int box_width = terminal_width * TERMINAL_WIDTH_PERCENTAGE / TERMINAL_WIDTH_DIVISOR;
-            if (box_width > MAX_BOX_WIDTH)
-                box_width = MAX_BOX_WIDTH;
-            if (box_width < MIN_BOX_WIDTH)
-                box_width = MIN_BOX_WIDTH;
-            int content_width = box_width - FRAME_PADDING;
+    // A running --daemon has done the scan already; its snapshot holds the
+    // deduplicated drives of the real root, SMART included
+    bool from_snapshot = !opt_no_snapshot && !opt_profile && !opt_no_dedup && !system_root[0] &&
+                         read_snapshot(&drives);
+    if (!from_snapshot)
+        discover_drives(&drives);
 
-            int bar_visible_len = visible_length(drive->progress_bar);
-            int bar_padding = content_width - bar_visible_len;
-            printf("  %s%*s\n", drive->progress_bar, bar_padding, "");
+    // Sort first: with --top, SMART only runs for the drives that are kept
+    profile_mark_t mark = profile_begin();
+    sort_drives(&drives);
+    profile_end(PROFILE_SORT, mark);
 
-            // Free allocated memory
-            free(drive->progress_bar);
-        }
+    if (!from_snapshot) {
+        mark = profile_begin();
+        collect_smart_info(&drives);
+        profile_end(PROFILE_SMART, mark);
+    }
 
-        if (drive_count == 0)
-        {
-            printf("No drives found.\n");
-        }
-        else
-        {
-            printf("A total of %d drives found.\n", drive_count);
-        }
+    if (opt_format == FORMAT_JSON) {
+        print_json(&drives);
+    } else if (opt_format != FORMAT_TEXT) {
+        mark = profile_begin();
+        print_document(&drives);
+        profile_end(PROFILE_RENDER, mark);
+        if (opt_profile)
+            print_profile(stderr);
+    } else {
+        mark = profile_begin();
+        strbuf_t report = {0};
+        layout_t layout = compute_layout(get_terminal_width());
+        render_text_report(&report, &drives, &layout);
+        write_output(&report);
+        strbuf_free(&report);
+        profile_end(PROFILE_RENDER, mark);
+        if (opt_profile)
+            print_profile(stderr);
     }
 
-    return 0;
+    free_drive_table(&drives);
+    free_where_program(&where_program);
+    return output_failed ? 1 : 0;
 }